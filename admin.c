@@ -114,6 +114,7 @@ static void __nvmev_admin_create_sq(int eid)
 	struct nvme_create_sq *cmd = &sq_entry(eid).create_sq;
 	struct nvmev_submission_queue *sq;
 	unsigned int num_pages, i;
+	void *cmb;
 	int dbs_idx;
 
 	sq = kzalloc(sizeof(struct nvmev_submission_queue), GFP_KERNEL);
@@ -131,8 +132,10 @@ static void __nvmev_admin_create_sq(int eid)
 	num_pages = DIV_ROUND_UP(sq->queue_size * sizeof(struct nvme_command), PAGE_SIZE);
 	sq->sq = kzalloc(sizeof(struct nvme_command *) * num_pages, GFP_KERNEL);
 
+	/* an SQ in the CMB is read from device memory */
+	cmb = nvmev_cmb_vaddr(cmd->prp1);
 	for (i = 0; i < num_pages; i++) {
-		sq->sq[i] = prp_address_offset(cmd->prp1, i);
+		sq->sq[i] = cmb ? cmb + PAGE_SIZE * i : prp_address_offset(cmd->prp1, i);
 	}
 	nvmev_vdev->sqes[sq->qid] = sq;
 
@@ -245,16 +248,44 @@ static void __nvmev_admin_get_log_page(int eid)
 /***
  * Identify functions
  */
-static void __nvmev_admin_identify_namespace(int eid)
+
+/* the namespace of @nsid if it is allocated, and attached unless @allocated */
+static struct nvmev_ns *__lookup_ns(u32 nsid, bool allocated)
+{
+	struct nvmev_ns *ns;
+
+	if (nsid == 0 || nsid > nvmev_vdev->nr_ns)
+		return NULL;
+
+	ns = &nvmev_vdev->ns[nsid - 1];
+	if (!ns->capacity || (!allocated && !ns->attached))
+		return NULL;
+
+	return ns;
+}
+
+static void __nvmev_admin_identify_namespace(int eid, bool allocated)
 {
 	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
 	struct nvme_id_ns *ns;
 	struct nvme_identify *cmd = &sq_entry(eid).identify;
-	size_t nsid = cmd->nsid - 1;
+	struct nvmev_ns *nvmev_ns = __lookup_ns(cmd->nsid, allocated);
+	bool all = (cmd->nsid == NVME_NSID_ALL);
+
+	if (!all && (cmd->nsid == 0 || cmd->nsid > nvmev_vdev->nr_ns)) {
+		__make_cq_entry(eid, NVME_SC_INVALID_NS);
+		return;
+	}
 
 	ns = prp_address(cmd->prp1);
 	memset(ns, 0x0, PAGE_SIZE);
 
+	/* an inactive nsid reads as zeroes */
+	if (!nvmev_ns && !all) {
+		__make_cq_entry(eid, NVME_SC_SUCCESS);
+		return;
+	}
+
 	ns->lbaf[0].ms = 0;
 	ns->lbaf[0].ds = 9;
 	ns->lbaf[0].rp = NVME_LBAF_RP_GOOD;
@@ -294,14 +325,21 @@ static void __nvmev_admin_identify_namespace(int eid)
 	ns->nlbaf = 6;
 	ns->dps = 0;
 
-	ns->nsze = (nvmev_vdev->ns[nsid].size >> ns->lbaf[ns->flbas].ds);
+	/* NSID_ALL: the capabilities common to all namespaces, no size */
+	if (all) {
+		__make_cq_entry(eid, NVME_SC_SUCCESS);
+		return;
+	}
+
+	ns->nsze = (nvmev_ns->size >> ns->lbaf[ns->flbas].ds);
 	ns->ncap = ns->nsze;
 	ns->nuse = ns->nsze;
+	ns->nvmcap[0] = nvmev_ns->capacity;
 
 	__make_cq_entry(eid, NVME_SC_SUCCESS);
 }
 
-static void __nvmev_admin_identify_namespaces(int eid)
+static void __nvmev_admin_identify_namespaces(int eid, bool allocated)
 {
 	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
 	struct nvme_identify *cmd = &sq_entry(eid).identify;
@@ -312,7 +350,7 @@ static void __nvmev_admin_identify_namespaces(int eid)
 	memset(ns, 0x00, PAGE_SIZE * 2);
 
 	for (i = 1; i <= nvmev_vdev->nr_ns; i++) {
-		if (i > cmd->nsid) {
+		if (i > cmd->nsid && __lookup_ns(i, allocated)) {
 			*ns = i;
 			ns++;
 		}
@@ -326,7 +364,12 @@ static void __nvmev_admin_identify_namespace_desc(int eid)
 	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
 	struct nvme_identify *cmd = &sq_entry(eid).identify;
 	struct nvme_id_ns_desc *ns_desc;
-	int nsid = cmd->nsid - 1;
+	struct nvmev_ns *ns = __lookup_ns(cmd->nsid, false);
+
+	if (!ns) {
+		__make_cq_entry(eid, NVME_SC_INVALID_NS);
+		return;
+	}
 
 	ns_desc = prp_address(cmd->prp1);
 	memset(ns_desc, 0x00, sizeof(*ns_desc));
@@ -334,7 +377,7 @@ static void __nvmev_admin_identify_namespace_desc(int eid)
 	ns_desc->nidt = NVME_NIDT_CSI;
 	ns_desc->nidl = 1;
 
-	ns_desc->nid[0] = nvmev_vdev->ns[nsid].csi; // Zoned Name Space Command Set
+	ns_desc->nid[0] = ns->csi; // Zoned Name Space Command Set
 
 	__make_cq_entry(eid, NVME_SC_SUCCESS);
 }
@@ -344,15 +387,16 @@ static void __nvmev_admin_identify_zns_namespace(int eid)
 	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
 	struct nvme_identify *cmd = &sq_entry(eid).identify;
 	struct nvme_id_zns_ns *ns;
-	int nsid = cmd->nsid - 1;
-	struct zns_ftl *zns_ftl = (struct zns_ftl *)nvmev_vdev->ns[nsid].ftls;
-	struct znsparams *zpp = &zns_ftl->zp;
+	struct nvmev_ns *nvmev_ns = __lookup_ns(cmd->nsid, false);
+	struct zns_ftl *zns_ftl;
+	struct znsparams *zpp;
 
-	if (NS_SSD_TYPE(nsid) != SSD_TYPE_ZNS) {
+	if (!nvmev_ns || nvmev_ns->csi != NVME_CSI_ZNS) {
 		__make_cq_entry(eid, NVME_SC_SUCCESS);
 		return;
 	}
-	BUG_ON(nvmev_vdev->ns[nsid].csi != NVME_CSI_ZNS);
+	zns_ftl = (struct zns_ftl *)nvmev_ns->ftls;
+	zpp = &zns_ftl->zp;
 
 	ns = prp_address(cmd->prp1);
 	memset(ns, 0x00, sizeof(*ns));
@@ -403,18 +447,37 @@ static void __nvmev_admin_identify_ctrl(int eid)
 	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
 	struct nvme_identify *cmd = &sq_entry(eid).identify;
 	struct nvme_id_ctrl *ctrl;
+	u64 allocated = 0;
+	int i;
 
 	ctrl = prp_address(cmd->prp1);
 	memset(ctrl, 0x00, sizeof(*ctrl));
 
+	for (i = 0; i < nvmev_vdev->nr_ns; i++)
+		allocated += nvmev_vdev->ns[i].capacity;
+
 	ctrl->nn = nvmev_vdev->nr_ns;
+	ctrl->oacs = NVME_CTRL_OACS_NS_MNGT;
+	ctrl->tnvmcap[0] = nvmev_vdev->config.storage_size;
+	ctrl->unvmcap[0] = nvmev_vdev->config.storage_size - allocated;
 	ctrl->oncs = 0; //optional command
+#if (SUPPORTED_SSD_TYPE(NVM) || SUPPORTED_SSD_TYPE(CONV) || SUPPORTED_SSD_TYPE(ZNS))
+	ctrl->oncs |= NVME_CTRL_ONCS_WRITE_ZEROES;
+#endif
+#if SUPPORTED_SSD_TYPE(CONV)
+	ctrl->oncs |= NVME_CTRL_ONCS_WRITE_UNCORRECTABLE;
+#endif
 	ctrl->acl = 3; //minimum 4 required, 0's based value
-	ctrl->vwc = 0;
+	/* writes complete early from the write buffer, so it is volatile */
+	ctrl->vwc = WRITE_EARLY_COMPLETION ? NVME_CTRL_VWC_PRESENT : 0;
 	snprintf(ctrl->sn, sizeof(ctrl->sn), "CSL_Virt_SN_%02d", 1);
 	snprintf(ctrl->mn, sizeof(ctrl->mn), "CSL_Virt_MN_%02d", 1);
 	snprintf(ctrl->fr, sizeof(ctrl->fr), "CSL_%03d", 2);
 	ctrl->mdts = nvmev_vdev->mdts;
+	ctrl->sgls = NVME_CTRL_SGLS_BYTE_ALIGNED | NVME_CTRL_SGLS_BIT_BUCKET;
+	/* the whole mapping table must fit, so the preferred size is the minimum */
+	ctrl->hmpre = nvmev_vdev->hmb_pref;
+	ctrl->hmmin = nvmev_vdev->hmb_pref;
 	ctrl->sqes = 0x66;
 	ctrl->cqes = 0x44;
 
@@ -428,13 +491,13 @@ static void __nvmev_admin_identify(int eid)
 
 	switch (cns) {
 	case 0x00:
-		__nvmev_admin_identify_namespace(eid);
+		__nvmev_admin_identify_namespace(eid, false);
 		break;
 	case 0x01:
 		__nvmev_admin_identify_ctrl(eid);
 		break;
 	case 0x02:
-		__nvmev_admin_identify_namespaces(eid);
+		__nvmev_admin_identify_namespaces(eid, false);
 		break;
 	case 0x03:
 		__nvmev_admin_identify_namespace_desc(eid);
@@ -445,6 +508,12 @@ static void __nvmev_admin_identify(int eid)
 	case 0x06:
 		__nvmev_admin_identify_zns_ctrl(eid);
 		break;
+	case 0x10:
+		__nvmev_admin_identify_namespaces(eid, true);
+		break;
+	case 0x11:
+		__nvmev_admin_identify_namespace(eid, true);
+		break;
 	default:
 		__make_cq_entry(eid, NVME_SC_INVALID_OPCODE);
 		NVMEV_ERROR("I don't know %d\n", cns);
@@ -461,6 +530,7 @@ static void __nvmev_admin_set_features(int eid)
 	struct nvme_features *cmd = &sq_entry(eid).features;
 	__le32 result0 = 0;
 	__le32 result1 = 0;
+	u16 status = NVME_SC_SUCCESS;
 
 	switch (cmd->fid) {
 	case NVME_FEAT_ARBITRATION:
@@ -468,7 +538,28 @@ static void __nvmev_admin_set_features(int eid)
 	case NVME_FEAT_LBA_RANGE:
 	case NVME_FEAT_TEMP_THRESH:
 	case NVME_FEAT_ERR_RECOVERY:
+		break;
 	case NVME_FEAT_VOLATILE_WC:
+		if (!WRITE_EARLY_COMPLETION)
+			status = NVME_SC_INVALID_FIELD;
+		else
+			nvmev_vdev->vwc_enabled = cmd->dword11 & 0x1;
+		break;
+	case NVME_FEAT_HOST_MEM_BUF:
+		/*
+		 * The mapping table is only modelled in the HMB, so the buffer
+		 * itself and its descriptor list are never accessed.
+		 */
+		if (!(cmd->dword11 & NVME_HOST_MEM_ENABLE)) {
+			nvmev_vdev->hmb_enabled = false;
+			nvmev_vdev->hmb_size = 0;
+		} else if (nvmev_vdev->hmb_pref == 0 || cmd->dword12 < nvmev_vdev->hmb_pref ||
+			   cmd->dword15 == 0) {
+			status = NVME_SC_INVALID_FIELD;
+		} else {
+			nvmev_vdev->hmb_enabled = true;
+			nvmev_vdev->hmb_size = cmd->dword12;
+		}
 		break;
 	case NVME_FEAT_NUM_QUEUES: {
 		int num_queue;
@@ -497,7 +588,7 @@ static void __nvmev_admin_set_features(int eid)
 		break;
 	}
 
-	__make_cq_entry_results(eid, NVME_SC_SUCCESS, result0, result1);
+	__make_cq_entry_results(eid, status, result0, result1);
 }
 
 static void __nvmev_admin_get_features(int eid)
@@ -513,7 +604,12 @@ static void __nvmev_admin_get_features(int eid)
 	case NVME_FEAT_LBA_RANGE:
 	case NVME_FEAT_TEMP_THRESH:
 	case NVME_FEAT_ERR_RECOVERY:
+		break;
 	case NVME_FEAT_VOLATILE_WC:
+		result0 = nvmev_vdev->vwc_enabled;
+		break;
+	case NVME_FEAT_HOST_MEM_BUF:
+		result0 = nvmev_vdev->hmb_enabled ? NVME_HOST_MEM_ENABLE : 0;
 		break;
 	case NVME_FEAT_NUM_QUEUES:
 		result0 = ((nvmev_vdev->nr_cq - 1) << 16 | (nvmev_vdev->nr_sq - 1));
@@ -535,6 +631,141 @@ static void __nvmev_admin_get_features(int eid)
 }
 
 
+/***
+ * Namespace management
+ */
+
+/* the FTL serving namespaces of @csi in this build, -1 if there is none */
+static int __csi_ssd_type(u8 csi)
+{
+	switch (csi) {
+	case NVME_CSI_NVM:
+#if SUPPORTED_SSD_TYPE(CONV)
+		return SSD_TYPE_CONV;
+#elif SUPPORTED_SSD_TYPE(NVM)
+		return SSD_TYPE_NVM;
+#else
+		return -1;
+#endif
+#if SUPPORTED_SSD_TYPE(ZNS)
+	case NVME_CSI_ZNS:
+		return SSD_TYPE_ZNS;
+#endif
+#if SUPPORTED_SSD_TYPE(KV)
+	case NVME_CSI_KV:
+		return SSD_TYPE_KV;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/*
+ * The size of a new namespace is the storage it is given, rounded down to
+ * whole flash pages or zones. The FTL keeps its over-provisioning out of it,
+ * so the reported nsze may be smaller.
+ */
+static void __nvmev_admin_ns_mgmt(int eid)
+{
+	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
+	struct nvme_common_command *cmd = &sq_entry(eid).common;
+	unsigned int sel = cmd->cdw10[0] & 0xf;
+	u16 status = NVME_SC_SUCCESS;
+	u32 result0 = 0;
+
+	if (sel == NVME_NS_MGMT_SEL_CREATE) {
+		struct nvme_id_ns *id_ns = prp_address(cmd->prp1);
+		int ssd_type = __csi_ssd_type(cmd->cdw10[1] >> 24);
+		int id;
+
+		if (ssd_type < 0 || id_ns->nsze == 0) {
+			status = NVME_SC_INVALID_FIELD;
+		} else if ((id_ns->flbas & 0xf) != (LBA_BITS == 9 ? 0 : 3)) {
+			status = NVME_SC_INVALID_FORMAT;
+		} else {
+			id = nvmev_create_namespace(ssd_type, id_ns->nsze << LBA_BITS);
+			if (id == -ENOSPC)
+				status = NVME_SC_NS_ID_UNAVAILABLE;
+			else if (id == -EINVAL)
+				status = NVME_SC_INVALID_FIELD;
+			else if (id < 0)
+				status = NVME_SC_NS_INSUFFICIENT_CAP;
+			else
+				result0 = id + 1;
+		}
+	} else if (sel == NVME_NS_MGMT_SEL_DELETE) {
+		struct nvmev_ns *ns = __lookup_ns(cmd->nsid, true);
+		int i;
+
+		if (cmd->nsid == NVME_NSID_ALL) {
+			for (i = 0; i < nvmev_vdev->nr_ns; i++)
+				nvmev_vdev->ns[i].attached = false;
+			nvmev_drain_io_workers();
+
+			for (i = 0; i < nvmev_vdev->nr_ns; i++) {
+				if (nvmev_vdev->ns[i].capacity)
+					nvmev_delete_namespace(&nvmev_vdev->ns[i]);
+			}
+		} else if (ns) {
+			/*
+			 * Deleting an attached namespace detaches it. Commands
+			 * still in flight and the write buffer releases they
+			 * left behind have to finish before the FTLs go away.
+			 */
+			ns->attached = false;
+			nvmev_drain_io_workers();
+			nvmev_delete_namespace(ns);
+		} else {
+			status = NVME_SC_INVALID_FIELD;
+		}
+	} else {
+		status = NVME_SC_INVALID_FIELD;
+	}
+
+	__make_cq_entry_results(eid, status, result0, 0);
+}
+
+static void __nvmev_admin_ns_attach(int eid)
+{
+	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
+	struct nvme_common_command *cmd = &sq_entry(eid).common;
+	struct nvme_ctrl_list *list = prp_address(cmd->prp1);
+	struct nvmev_ns *ns = __lookup_ns(cmd->nsid, true);
+	unsigned int sel = cmd->cdw10[0] & 0xf;
+	u16 status = NVME_SC_SUCCESS;
+	int i;
+
+	if (!ns) {
+		__make_cq_entry(eid, NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	/* this is the only controller, cntlid 0 */
+	for (i = 0; i < min_t(int, list->num, ARRAY_SIZE(list->identifier)); i++) {
+		if (list->identifier[i] == 0)
+			break;
+	}
+	if (i == min_t(int, list->num, ARRAY_SIZE(list->identifier))) {
+		__make_cq_entry(eid, NVME_SC_CTRL_LIST_INVALID);
+		return;
+	}
+
+	if (sel == NVME_NS_ATTACH_SEL_CTRL_ATTACH) {
+		if (ns->attached)
+			status = NVME_SC_NS_ALREADY_ATTACHED;
+		ns->attached = true;
+	} else if (sel == NVME_NS_ATTACH_SEL_CTRL_DEATTACH) {
+		if (!ns->attached)
+			status = NVME_SC_NS_NOT_ATTACHED;
+		ns->attached = false;
+	} else {
+		status = NVME_SC_INVALID_FIELD;
+	}
+
+	__make_cq_entry(eid, status);
+}
+
+
 /***
  * Misc
  */
@@ -583,6 +814,12 @@ static void __nvmev_proc_admin_req(int entry_id)
 	case nvme_admin_async_event:
 		__nvmev_admin_async_event(entry_id);
 		break;
+	case nvme_admin_ns_mgmt:
+		__nvmev_admin_ns_mgmt(entry_id);
+		break;
+	case nvme_admin_ns_attach:
+		__nvmev_admin_ns_attach(entry_id);
+		break;
 	case nvme_admin_activate_fw:
 	case nvme_admin_download_fw:
 	case nvme_admin_format_nvm:
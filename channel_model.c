@@ -8,9 +8,10 @@
 #include "nvmev.h"
 #include "channel_model.h"
 
+/* the dispatcher's batch time, channels are only advanced from the dispatcher */
 static inline unsigned long long __get_wallclock(void)
 {
-	return cpu_clock(nvmev_vdev->config.cpu_nr_dispatcher);
+	return nvmev_vdev->nsecs_batch;
 }
 
 void chmodel_init(struct channel_model *ch, uint64_t bandwidth /*MB/s*/)
@@ -22,12 +23,27 @@ void chmodel_init(struct channel_model *ch, uint64_t bandwidth /*MB/s*/)
 	ch->command_credits = 0;
 	ch->xfer_lat = BANDWIDTH_TO_TX_TIME(bandwidth);
 
+#if (CHMODEL_TYPE == CHMODEL_VFT)
+	ch->vft = 0;
+#else
 	MEMSET(&(ch->avail_credits[0]), ch->max_credits, NR_CREDIT_ENTRIES);
+#endif
 
 	NVMEV_INFO("[%s] bandwidth %llu max_credits %u tx_time %u\n", __func__, bandwidth,
 		   ch->max_credits, ch->xfer_lat);
 }
 
+#if (CHMODEL_TYPE == CHMODEL_VFT)
+uint64_t chmodel_request(struct channel_model *ch, uint64_t request_time, uint64_t length)
+{
+	uint64_t units_to_xfer = DIV_ROUND_UP(length, UNIT_XFER_SIZE);
+	uint64_t stime = max(request_time, ch->vft);
+
+	ch->vft = stime + ch->xfer_lat * units_to_xfer;
+
+	return ch->vft;
+}
+#else
 uint64_t chmodel_request(struct channel_model *ch, uint64_t request_time, uint64_t length)
 {
 	uint64_t cur_time = __get_wallclock();
@@ -118,3 +134,4 @@ uint64_t chmodel_request(struct channel_model *ch, uint64_t request_time, uint64
 
 	return request_time + total_latency;
 }
+#endif
@@ -3,6 +3,19 @@
 #ifndef _CHANNEL_MODEL_H
 #define _CHANNEL_MODEL_H
 
+/*
+ * Channel model type, selected at build time (e.g. -DCHMODEL_TYPE=CHMODEL_VFT)
+ * CHMODEL_CREDIT: per-slot credit ring, handles requests arriving out of time order
+ * CHMODEL_VFT: virtual finish time, O(1) per request and no horizon limit,
+ *              requests are serialized in the order they are issued
+ */
+#define CHMODEL_CREDIT 0
+#define CHMODEL_VFT 1
+
+#ifndef CHMODEL_TYPE
+#define CHMODEL_TYPE CHMODEL_CREDIT
+#endif
+
 /* Macros for channel model */
 #define NR_CREDIT_ENTRIES (1024 * 96)
 #define UNIT_TIME_INTERVAL (4000ULL) //ns
@@ -34,7 +47,11 @@ struct channel_model {
 	uint32_t command_credits;
 	uint32_t xfer_lat; /*XKB NAND CH transfer time in nanoseconds*/
 
+#if (CHMODEL_TYPE == CHMODEL_VFT)
+	uint64_t vft; /* virtual finish time of the last transfer */
+#else
 	credit_t avail_credits[NR_CREDIT_ENTRIES];
+#endif
 };
 
 #define BANDWIDTH_TO_TX_TIME(MB_S) (((UNIT_XFER_SIZE)*NS_PER_SEC(1)) / (MB(MB_S)))
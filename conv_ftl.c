@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-only
+#include <linux/hash.h>
 #include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/sched/clock.h>
 
 #include "nvmev.h"
@@ -68,6 +70,53 @@ static inline void set_maptbl_ent(struct conv_ftl *conv_ftl, uint64_t lpn, struc
 	conv_ftl->maptbl[lpn] = *ppa;
 }
 
+/*
+ * Make the mapping segment of lpn resident in the L2P cache and return when
+ * its entries are available: at once on a hit, after an HMB fetch on a miss.
+ * A dirty victim is written back to the HMB first.
+ */
+static uint64_t l2p_cache_access(struct conv_ftl *conv_ftl, uint64_t lpn, bool dirty,
+				 uint64_t nsecs_start)
+{
+	struct l2p_cache *lc = &conv_ftl->lc;
+	struct l2p_cache_entry *entry;
+	uint64_t seg = lpn / L2P_SEG_ENTRIES;
+	uint64_t nsecs = nsecs_start;
+
+	if (lc->slots[seg] != L2P_NO_SLOT) {
+		entry = &lc->entries[lc->slots[seg]];
+		entry->ref = true;
+		entry->dirty |= dirty;
+		atomic64_inc(&nvmev_vdev->l2p_hits);
+		return nsecs_start;
+	}
+	atomic64_inc(&nvmev_vdev->l2p_misses);
+
+	/* CLOCK: evict the first entry without a reference bit */
+	while (lc->entries[lc->hand].ref) {
+		lc->entries[lc->hand].ref = false;
+		lc->hand = (lc->hand + 1) % lc->nr_entries;
+	}
+	entry = &lc->entries[lc->hand];
+
+	if (entry->seg != INVALID_LPN) {
+		/* posted write, no round trip */
+		if (entry->dirty) {
+			nsecs = ssd_advance_pcie(conv_ftl->ssd, nsecs, L2P_SEG_SIZE);
+			atomic64_inc(&nvmev_vdev->l2p_writebacks);
+		}
+		lc->slots[entry->seg] = L2P_NO_SLOT;
+	}
+
+	entry->seg = seg;
+	entry->ref = false;
+	entry->dirty = dirty;
+	lc->slots[seg] = lc->hand;
+	lc->hand = (lc->hand + 1) % lc->nr_entries;
+
+	return ssd_advance_pcie(conv_ftl->ssd, nsecs + conv_ftl->cp.hmb_lat, L2P_SEG_SIZE);
+}
+
 static uint64_t ppa2pgidx(struct conv_ftl *conv_ftl, struct ppa *ppa)
 {
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
@@ -129,13 +178,14 @@ static inline void consume_write_credit(struct conv_ftl *conv_ftl)
 	conv_ftl->wfc.write_credits--;
 }
 
-static void foreground_gc(struct conv_ftl *conv_ftl);
+static void foreground_gc(struct conv_ftl *conv_ftl, uint64_t nsecs_start);
+static void rc_invalidate_block(struct conv_ftl *conv_ftl, struct ppa *ppa);
 
-static inline void check_and_refill_write_credit(struct conv_ftl *conv_ftl)
+static inline void check_and_refill_write_credit(struct conv_ftl *conv_ftl, uint64_t nsecs_start)
 {
 	struct write_flow_control *wfc = &(conv_ftl->wfc);
 	if (wfc->write_credits <= 0) {
-		foreground_gc(conv_ftl);
+		foreground_gc(conv_ftl, nsecs_start);
 
 		wfc->write_credits += wfc->credits_to_refill;
 	}
@@ -154,6 +204,7 @@ static void init_lines(struct conv_ftl *conv_ftl)
 
 	INIT_LIST_HEAD(&lm->free_line_list);
 	INIT_LIST_HEAD(&lm->full_line_list);
+	INIT_LIST_HEAD(&lm->slc_line_list);
 
 	lm->victim_line_pq = pqueue_init(spp->tt_lines, victim_line_cmp_pri, victim_line_get_pri,
 					 victim_line_set_pri, victim_line_get_pos,
@@ -165,6 +216,7 @@ static void init_lines(struct conv_ftl *conv_ftl)
 			.id = i,
 			.ipc = 0,
 			.vpc = 0,
+			.slc = false,
 			.pos = 0,
 			.entry = LIST_HEAD_INIT(lm->lines[i].entry),
 		};
@@ -177,6 +229,8 @@ static void init_lines(struct conv_ftl *conv_ftl)
 	NVMEV_ASSERT(lm->free_line_cnt == lm->tt_lines);
 	lm->victim_line_cnt = 0;
 	lm->full_line_cnt = 0;
+	lm->slc_line_cnt = 0;
+	lm->slc_max_lines = lm->tt_lines * conv_ftl->cp.slc_pcent / 100;
 }
 
 static void remove_lines(struct conv_ftl *conv_ftl)
@@ -215,6 +269,43 @@ static struct line *get_next_free_line(struct conv_ftl *conv_ftl)
 	return curline;
 }
 
+static inline uint32_t line_pgs_per_blk(struct conv_ftl *conv_ftl, struct line *line)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+
+	return line->slc ? spp->slc_pgs_per_blk : spp->pgs_per_blk;
+}
+
+/*
+ * Host writes go to SLC lines while the cache has room and free lines are
+ * plentiful; afterwards they fall back to native (slow) programming.
+ */
+static void open_line(struct conv_ftl *conv_ftl, struct line *line, uint32_t io_type)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct line_mgmt *lm = &conv_ftl->lm;
+	struct ppa ppa;
+	int ch, lun, pl;
+
+	line->slc = (io_type == USER_IO) && (lm->slc_line_cnt < lm->slc_max_lines) &&
+		    (lm->free_line_cnt > conv_ftl->cp.gc_thres_lines_high + 1);
+	if (line->slc)
+		lm->slc_line_cnt++;
+
+	ppa.ppa = 0;
+	ppa.g.blk = line->id;
+	for (ch = 0; ch < spp->nchs; ch++) {
+		for (lun = 0; lun < spp->luns_per_ch; lun++) {
+			for (pl = 0; pl < spp->pls_per_lun; pl++) {
+				ppa.g.ch = ch;
+				ppa.g.lun = lun;
+				ppa.g.pl = pl;
+				get_blk(conv_ftl->ssd, &ppa)->slc = line->slc;
+			}
+		}
+	}
+}
+
 static struct write_pointer *__get_wp(struct conv_ftl *ftl, uint32_t io_type)
 {
 	if (io_type == USER_IO) {
@@ -234,6 +325,7 @@ static void prepare_write_pointer(struct conv_ftl *conv_ftl, uint32_t io_type)
 
 	NVMEV_ASSERT(wp);
 	NVMEV_ASSERT(curline);
+	open_line(conv_ftl, curline, io_type);
 
 	/* wp->curline is always our next-to-write super-block */
 	*wp = (struct write_pointer){
@@ -255,7 +347,7 @@ static void advance_write_pointer(struct conv_ftl *conv_ftl, uint32_t io_type)
 	NVMEV_DEBUG_VERBOSE("current wpp: ch:%d, lun:%d, pl:%d, blk:%d, pg:%d\n",
 			wpp->ch, wpp->lun, wpp->pl, wpp->blk, wpp->pg);
 
-	check_addr(wpp->pg, spp->pgs_per_blk);
+	check_addr(wpp->pg, line_pgs_per_blk(conv_ftl, wpp->curline));
 	wpp->pg++;
 	if ((wpp->pg % spp->pgs_per_oneshotpg) != 0)
 		goto out;
@@ -274,14 +366,25 @@ static void advance_write_pointer(struct conv_ftl *conv_ftl, uint32_t io_type)
 		goto out;
 
 	wpp->lun = 0;
+	check_addr(wpp->pl, spp->pls_per_lun);
+	wpp->pl++;
+	/* stripe over the planes of each lun before moving on */
+	if (wpp->pl != spp->pls_per_lun)
+		goto out;
+
+	wpp->pl = 0;
 	/* go to next wordline in the block */
 	wpp->pg += spp->pgs_per_oneshotpg;
-	if (wpp->pg != spp->pgs_per_blk)
+	if (wpp->pg != line_pgs_per_blk(conv_ftl, wpp->curline))
 		goto out;
 
 	wpp->pg = 0;
-	/* move current line to {victim,full} line list */
-	if (wpp->curline->vpc == spp->pgs_per_line) {
+	/* move current line to {slc,victim,full} line list */
+	if (wpp->curline->slc) {
+		/* SLC lines are only reclaimed by folding */
+		list_add_tail(&wpp->curline->entry, &lm->slc_line_list);
+		NVMEV_DEBUG_VERBOSE("wpp: move line to slc_line_list\n");
+	} else if (wpp->curline->vpc == spp->pgs_per_line) {
 		/* all pgs are still valid, move to full line list */
 		NVMEV_ASSERT(wpp->curline->ipc == 0);
 		list_add_tail(&wpp->curline->entry, &lm->full_line_list);
@@ -298,6 +401,7 @@ static void advance_write_pointer(struct conv_ftl *conv_ftl, uint32_t io_type)
 	/* current line is used up, pick another empty line */
 	check_addr(wpp->blk, spp->blks_per_pl);
 	wpp->curline = get_next_free_line(conv_ftl);
+	open_line(conv_ftl, wpp->curline, io_type);
 	NVMEV_DEBUG_VERBOSE("wpp: got new clean line %d\n", wpp->curline->id);
 
 	wpp->blk = wpp->curline->id;
@@ -307,7 +411,6 @@ static void advance_write_pointer(struct conv_ftl *conv_ftl, uint32_t io_type)
 	NVMEV_ASSERT(wpp->pg == 0);
 	NVMEV_ASSERT(wpp->lun == 0);
 	NVMEV_ASSERT(wpp->ch == 0);
-	/* TODO: assume # of pl_per_lun is 1, fix later */
 	NVMEV_ASSERT(wpp->pl == 0);
 out:
 	NVMEV_DEBUG_VERBOSE("advanced wpp: ch:%d, lun:%d, pl:%d, blk:%d, pg:%d (curline %d)\n",
@@ -326,8 +429,6 @@ static struct ppa get_new_page(struct conv_ftl *conv_ftl, uint32_t io_type)
 	ppa.g.blk = wp->blk;
 	ppa.g.pl = wp->pl;
 
-	NVMEV_ASSERT(ppa.g.pl == 0);
-
 	return ppa;
 }
 
@@ -363,6 +464,170 @@ static void remove_rmap(struct conv_ftl *conv_ftl)
 	vfree(conv_ftl->rmap);
 }
 
+static void init_read_cache(struct conv_ftl *conv_ftl)
+{
+	struct read_cache *rc = &conv_ftl->rc;
+	int i;
+
+	rc->nr_entries = conv_ftl->cp.rc_flashpgs;
+	rc->hand = 0;
+	rc->next_lpn = INVALID_LPN;
+	rc->seq_cnt = 0;
+	rc->entries = NULL;
+	rc->buckets = NULL;
+
+	if (!rc->nr_entries)
+		return;
+
+	rc->hash_bits = ilog2(roundup_pow_of_two(rc->nr_entries));
+	rc->entries = kmalloc(sizeof(struct read_cache_entry) * rc->nr_entries, GFP_KERNEL);
+	rc->buckets = kcalloc(1U << rc->hash_bits, sizeof(struct hlist_head), GFP_KERNEL);
+	if (!rc->entries || !rc->buckets) {
+		NVMEV_ERROR("Failed to allocate the read cache, running without it\n");
+		kfree(rc->entries);
+		kfree(rc->buckets);
+		rc->entries = NULL;
+		rc->buckets = NULL;
+		rc->nr_entries = 0;
+		return;
+	}
+
+	for (i = 0; i < rc->nr_entries; i++) {
+		rc->entries[i].ppa.ppa = UNMAPPED_PPA;
+		rc->entries[i].ref = false;
+		rc->entries[i].prefetched = false;
+		INIT_HLIST_NODE(&rc->entries[i].hnode);
+	}
+}
+
+static void remove_read_cache(struct conv_ftl *conv_ftl)
+{
+	kfree(conv_ftl->rc.buckets);
+	kfree(conv_ftl->rc.entries);
+}
+
+static void init_l2p_cache(struct conv_ftl *conv_ftl)
+{
+	struct l2p_cache *lc = &conv_ftl->lc;
+	uint64_t nr_segs = DIV_ROUND_UP(conv_ftl->ssd->sp.tt_pgs, L2P_SEG_ENTRIES);
+	uint64_t i;
+
+	lc->nr_entries = min_t(uint64_t, conv_ftl->cp.l2p_cache_segs, nr_segs);
+	lc->hand = 0;
+	lc->entries = NULL;
+	lc->slots = NULL;
+
+	if (!lc->nr_entries)
+		return;
+
+	lc->entries = kmalloc(sizeof(struct l2p_cache_entry) * lc->nr_entries, GFP_KERNEL);
+	for (i = 0; i < lc->nr_entries; i++) {
+		lc->entries[i].seg = INVALID_LPN;
+		lc->entries[i].ref = false;
+		lc->entries[i].dirty = false;
+	}
+
+	lc->slots = vmalloc(sizeof(uint32_t) * nr_segs);
+	for (i = 0; i < nr_segs; i++)
+		lc->slots[i] = L2P_NO_SLOT;
+}
+
+static void remove_l2p_cache(struct conv_ftl *conv_ftl)
+{
+	kfree(conv_ftl->lc.entries);
+	vfree(conv_ftl->lc.slots);
+}
+
+static void init_cmt(struct conv_ftl *conv_ftl)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct cmt *cmt = &conv_ftl->cmt;
+	uint32_t nr_tpgs;
+	uint32_t i;
+
+	cmt->ents_per_tpg = spp->pgsz / L2P_ENTRY_SIZE;
+	nr_tpgs = DIV_ROUND_UP(spp->tt_pgs, cmt->ents_per_tpg);
+	cmt->nr_entries = min(conv_ftl->cp.cmt_tpgs, nr_tpgs);
+	cmt->nr_used = 0;
+	INIT_LIST_HEAD(&cmt->lru);
+	cmt->entries = NULL;
+	cmt->slots = NULL;
+	cmt->gtd = NULL;
+
+	if (!cmt->nr_entries)
+		return;
+
+	cmt->entries = kmalloc(sizeof(struct cmt_entry) * cmt->nr_entries, GFP_KERNEL);
+
+	cmt->slots = vmalloc(sizeof(uint32_t) * nr_tpgs);
+	cmt->gtd = vmalloc(sizeof(struct ppa) * nr_tpgs);
+	for (i = 0; i < nr_tpgs; i++) {
+		cmt->slots[i] = L2P_NO_SLOT;
+		cmt->gtd[i].ppa = UNMAPPED_PPA;
+	}
+}
+
+static void remove_cmt(struct conv_ftl *conv_ftl)
+{
+	kfree(conv_ftl->cmt.entries);
+	vfree(conv_ftl->cmt.slots);
+	vfree(conv_ftl->cmt.gtd);
+}
+
+static void remove_read_ops(struct conv_ftl *conv_ftls, uint32_t nr_parts)
+{
+	uint32_t i;
+
+	kfree(conv_ftls[0].ro.ops);
+	kfree(conv_ftls[0].ro.order);
+	kfree(conv_ftls[0].ro.round_cnt);
+	for (i = 0; i < nr_parts; i++)
+		kfree(conv_ftls[i].ro.lun_ops);
+}
+
+/*
+ * A batch holds a command of MDTS, longer commands take several. A namespace
+ * has one batch, kept by its first partition, and LUN counters per partition.
+ */
+static int init_read_ops(struct conv_ftl *conv_ftls, uint32_t nr_parts)
+{
+	struct ssdparams *spp = &conv_ftls[0].ssd->sp;
+	struct conv_read_ops *ro = &conv_ftls[0].ro;
+	bool failed = false;
+	uint32_t i;
+
+	for (i = 0; i < nr_parts; i++) {
+		conv_ftls[i].ro = (struct conv_read_ops){ 0 };
+		conv_ftls[i].ro.lun_ops =
+			kcalloc(spp->nchs * spp->luns_per_ch, sizeof(uint32_t), GFP_KERNEL);
+		failed |= !conv_ftls[i].ro.lun_ops;
+	}
+
+	ro->max_ops = (KB(4) << MDTS) / spp->pgsz + 1;
+	ro->ops = kmalloc_array(ro->max_ops, sizeof(struct conv_read_op), GFP_KERNEL);
+	ro->order = kmalloc_array(ro->max_ops, sizeof(uint32_t), GFP_KERNEL);
+	ro->round_cnt = kmalloc_array(ro->max_ops + 1, sizeof(uint32_t), GFP_KERNEL);
+
+	if (failed || !ro->ops || !ro->order || !ro->round_cnt) {
+		NVMEV_ERROR("Failed to allocate the read planning space\n");
+		remove_read_ops(conv_ftls, nr_parts);
+		for (i = 0; i < nr_parts; i++)
+			conv_ftls[i].ro = (struct conv_read_ops){ 0 };
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* 4KiB pages of HMB needed for the mapping table of a namespace */
+static uint32_t conv_hmb_pages(struct conv_ftl *conv_ftls, uint32_t nr_parts)
+{
+	if (!conv_ftls[0].lc.nr_entries)
+		return 0;
+
+	return DIV_ROUND_UP(conv_ftls[0].ssd->sp.tt_pgs * nr_parts * L2P_ENTRY_SIZE, KB(4));
+}
+
 static void conv_init_ftl(struct conv_ftl *conv_ftl, struct convparams *cpp, struct ssd *ssd)
 {
 	/*copy convparams*/
@@ -382,9 +647,18 @@ static void conv_init_ftl(struct conv_ftl *conv_ftl, struct convparams *cpp, str
 	/* initialize write pointer, this is how we allocate new pages for writes */
 	prepare_write_pointer(conv_ftl, USER_IO);
 	prepare_write_pointer(conv_ftl, GC_IO);
+	conv_ftl->gc_ready_time = 0;
+	conv_ftl->gc_xfer_pgs = 0;
+	conv_ftl->last_flush_time = 0;
 
 	init_write_flow_control(conv_ftl);
 
+	init_read_cache(conv_ftl);
+
+	init_l2p_cache(conv_ftl);
+
+	init_cmt(conv_ftl);
+
 	NVMEV_INFO("Init FTL instance with %d channels (%ld pages)\n", conv_ftl->ssd->sp.nchs,
 		   conv_ftl->ssd->sp.tt_pgs);
 
@@ -393,6 +667,9 @@ static void conv_init_ftl(struct conv_ftl *conv_ftl, struct convparams *cpp, str
 
 static void conv_remove_ftl(struct conv_ftl *conv_ftl)
 {
+	remove_cmt(conv_ftl);
+	remove_l2p_cache(conv_ftl);
+	remove_read_cache(conv_ftl);
 	remove_lines(conv_ftl);
 	remove_rmap(conv_ftl);
 	remove_maptbl(conv_ftl);
@@ -403,19 +680,51 @@ static void conv_init_params(struct convparams *cpp)
 	cpp->op_area_pcent = OP_AREA_PERCENT;
 	cpp->gc_thres_lines = 2; /* Need only two lines.(host write, gc)*/
 	cpp->gc_thres_lines_high = 2; /* Need only two lines.(host write, gc)*/
-	cpp->enable_gc_delay = 0;
+	cpp->enable_gc_delay = 1;
+	cpp->enable_copyback = 0;
+	cpp->rc_flashpgs = READ_CACHE_FLASHPGS;
+	cpp->ra_flashpgs = READ_AHEAD_FLASHPGS;
+	cpp->ra_trigger = READ_AHEAD_TRIGGER;
+	cpp->slc_pcent = SLC_CACHE_PERCENT;
+	cpp->slc_fold_idle = SLC_FOLD_IDLE;
+	cpp->l2p_cache_segs = L2P_CACHE_SEGS;
+	cpp->hmb_lat = HMB_READ_LATENCY;
+	cpp->cmt_tpgs = CMT_TPAGES;
 	cpp->pba_pcent = (int)((1 + cpp->op_area_pcent) * 100);
 }
 
-void conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
-			 uint32_t cpu_nr_dispatcher)
+/*
+ * Round @size down to whole flash pages in every partition. Returns 0 if that
+ * leaves too few lines to keep the user and GC write pointers open above the
+ * GC threshold.
+ */
+uint64_t conv_fit_namespace_size(uint64_t size)
+{
+	struct ssdparams spp;
+	struct convparams cpp;
+	const uint32_t nr_parts = ssd_profile.nr_parts;
+
+	size = rounddown(size, (uint64_t)nr_parts * ssd_profile.flashpgsz);
+	if (!size)
+		return 0;
+
+	ssd_init_params(&spp, size, nr_parts);
+	conv_init_params(&cpp);
+	if (spp.tt_lines < cpp.gc_thres_lines_high + 3)
+		return 0;
+
+	return size;
+}
+
+int conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
+			uint32_t cpu_nr_dispatcher)
 {
 	struct ssdparams spp;
 	struct convparams cpp;
 	struct conv_ftl *conv_ftls;
 	struct ssd *ssd;
 	uint32_t i;
-	const uint32_t nr_parts = SSD_PARTITIONS;
+	const uint32_t nr_parts = ssd_profile.nr_parts;
 
 	ssd_init_params(&spp, size, nr_parts);
 	conv_init_params(&cpp);
@@ -446,18 +755,27 @@ void conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *
 	/*register io command handler*/
 	ns->proc_io_cmd = conv_proc_nvme_io_cmd;
 
+	nvmev_vdev->hmb_pref += conv_hmb_pages(conv_ftls, nr_parts);
+
+	if (init_read_ops(conv_ftls, nr_parts)) {
+		conv_remove_namespace(ns);
+		return -ENOMEM;
+	}
+
 	NVMEV_INFO("FTL physical space: %lld, logical space: %lld (physical/logical * 100 = %d)\n",
 		   size, ns->size, cpp.pba_pcent);
 
-	return;
+	return 0;
 }
 
 void conv_remove_namespace(struct nvmev_ns *ns)
 {
 	struct conv_ftl *conv_ftls = (struct conv_ftl *)ns->ftls;
-	const uint32_t nr_parts = SSD_PARTITIONS;
+	const uint32_t nr_parts = ssd_profile.nr_parts;
 	uint32_t i;
 
+	nvmev_vdev->hmb_pref -= conv_hmb_pages(conv_ftls, nr_parts);
+
 	/* PCIe, Write buffer are shared by all instances*/
 	for (i = 1; i < nr_parts; i++) {
 		/*
@@ -467,6 +785,8 @@ void conv_remove_namespace(struct nvmev_ns *ns)
 		conv_ftls[i].ssd->pcie = NULL;
 	}
 
+	remove_read_ops(conv_ftls, nr_parts);
+
 	for (i = 0; i < nr_parts; i++) {
 		conv_remove_ftl(&conv_ftls[i]);
 		ssd_remove(conv_ftls[i].ssd);
@@ -508,7 +828,12 @@ static inline bool valid_lpn(struct conv_ftl *conv_ftl, uint64_t lpn)
 
 static inline bool mapped_ppa(struct ppa *ppa)
 {
-	return !(ppa->ppa == UNMAPPED_PPA);
+	return !(ppa->ppa == UNMAPPED_PPA || ppa->ppa == UNCORRECTABLE_PPA);
+}
+
+static inline bool uncor_ppa(struct ppa *ppa)
+{
+	return ppa->ppa == UNCORRECTABLE_PPA;
 }
 
 static inline struct line *get_line(struct conv_ftl *conv_ftl, struct ppa *ppa)
@@ -606,9 +931,141 @@ static void mark_block_free(struct conv_ftl *conv_ftl, struct ppa *ppa)
 	blk->ipc = 0;
 	blk->vpc = 0;
 	blk->erase_cnt++;
+
+	rc_invalidate_block(conv_ftl, ppa);
 }
 
-static void gc_read_page(struct conv_ftl *conv_ftl, struct ppa *ppa)
+/* program the oneshot page of gc_wp once its last page is staged */
+static void gc_program_wordline(struct conv_ftl *conv_ftl, struct ppa *new_ppa)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct nand_cmd gcw = {
+		.type = GC_IO,
+		.cmd = NAND_WRITE,
+		.stime = conv_ftl->gc_ready_time,
+		.xfer_size = spp->pgsz * conv_ftl->gc_xfer_pgs,
+		.interleave_pci_dma = false,
+		.ppa = new_ppa,
+	};
+
+	if (!last_pg_in_wordline(conv_ftl, new_ppa))
+		return;
+
+	ssd_advance_nand(conv_ftl->ssd, &gcw);
+	conv_ftl->gc_ready_time = 0;
+	conv_ftl->gc_xfer_pgs = 0;
+}
+
+/* rmap entries of translation pages */
+#define TPAGE_LPN_FLAG (1ULL << 62)
+#define TPAGE_LPN(tpn) (TPAGE_LPN_FLAG | (tpn))
+#define TPAGE_TPN(lpn) ((lpn) & ~TPAGE_LPN_FLAG)
+
+static inline bool is_tpage_lpn(uint64_t lpn)
+{
+	return lpn != INVALID_LPN && (lpn & TPAGE_LPN_FLAG);
+}
+
+/*
+ * Program a dirty translation page. It goes through gc_wp and shares oneshot
+ * pages with GC data; the stale copy becomes garbage like any other page.
+ * The page takes a write credit like user data. GC writes back translation
+ * pages itself, so the credits are checked by the callers outside of GC.
+ */
+static void cmt_write_tpage(struct conv_ftl *conv_ftl, uint32_t tpn, uint64_t nsecs_ready)
+{
+	struct ppa *ppa = &conv_ftl->cmt.gtd[tpn];
+
+	if (mapped_ppa(ppa)) {
+		mark_page_invalid(conv_ftl, ppa);
+		set_rmap_ent(conv_ftl, INVALID_LPN, ppa);
+	}
+
+	*ppa = get_new_page(conv_ftl, GC_IO);
+	set_rmap_ent(conv_ftl, TPAGE_LPN(tpn), ppa);
+	mark_page_valid(conv_ftl, ppa);
+	advance_write_pointer(conv_ftl, GC_IO);
+
+	atomic64_inc(&nvmev_vdev->cmt_writebacks);
+	nvmev_vdev->device_write += conv_ftl->ssd->sp.pgsz;
+	consume_write_credit(conv_ftl);
+
+	if (conv_ftl->cp.enable_gc_delay) {
+		conv_ftl->gc_xfer_pgs++;
+		conv_ftl->gc_ready_time = max(conv_ftl->gc_ready_time, nsecs_ready);
+		gc_program_wordline(conv_ftl, ppa);
+	}
+}
+
+/*
+ * Make the translation page of lpn resident in the CMT and return when its
+ * entries are available: at once on a hit, after a NAND read on a miss. A
+ * dirty LRU victim is programmed, but the read does not wait for it.
+ */
+static uint64_t cmt_access(struct conv_ftl *conv_ftl, uint64_t lpn, bool dirty,
+			   uint64_t nsecs_start)
+{
+	struct cmt *cmt = &conv_ftl->cmt;
+	uint32_t tpn = lpn / cmt->ents_per_tpg;
+	struct cmt_entry *entry;
+	struct nand_cmd trd = {
+		.type = USER_IO,
+		.cmd = NAND_READ,
+		.stime = nsecs_start,
+		.xfer_size = conv_ftl->ssd->sp.pgsz,
+		.interleave_pci_dma = false,
+		.ppa = &cmt->gtd[tpn],
+	};
+
+	if (cmt->slots[tpn] != L2P_NO_SLOT) {
+		entry = &cmt->entries[cmt->slots[tpn]];
+		entry->dirty |= dirty;
+		list_move(&entry->lru, &cmt->lru);
+		atomic64_inc(&nvmev_vdev->cmt_hits);
+		return nsecs_start;
+	}
+	atomic64_inc(&nvmev_vdev->cmt_misses);
+
+	if (cmt->nr_used < cmt->nr_entries) {
+		entry = &cmt->entries[cmt->nr_used++];
+	} else {
+		entry = list_last_entry(&cmt->lru, struct cmt_entry, lru);
+		if (entry->dirty)
+			cmt_write_tpage(conv_ftl, entry->tpn, nsecs_start);
+		cmt->slots[entry->tpn] = L2P_NO_SLOT;
+		list_del(&entry->lru);
+	}
+
+	entry->tpn = tpn;
+	entry->dirty = dirty;
+	cmt->slots[tpn] = entry - cmt->entries;
+	list_add(&entry->lru, &cmt->lru);
+
+	/* a translation page that was never written holds no mapping */
+	if (!mapped_ppa(&cmt->gtd[tpn]))
+		return nsecs_start;
+
+	return ssd_advance_nand(conv_ftl->ssd, &trd);
+}
+
+/*
+ * When the mapping entry of lpn is available to the controller. A DRAM-less
+ * device caches part of the map and keeps the rest in the HMB if the host
+ * gave one, or on NAND otherwise.
+ */
+static uint64_t map_access(struct conv_ftl *conv_ftl, uint64_t lpn, bool dirty,
+			   uint64_t nsecs_start)
+{
+	if (conv_ftl->lc.nr_entries && nvmev_vdev->hmb_enabled)
+		return l2p_cache_access(conv_ftl, lpn, dirty, nsecs_start);
+
+	if (conv_ftl->cmt.nr_entries)
+		return cmt_access(conv_ftl, lpn, dirty, nsecs_start);
+
+	return nsecs_start;
+}
+
+static uint64_t gc_read_page(struct conv_ftl *conv_ftl, struct ppa *ppa, uint64_t nsecs_start)
 {
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct convparams *cpp = &conv_ftl->cp;
@@ -617,27 +1074,43 @@ static void gc_read_page(struct conv_ftl *conv_ftl, struct ppa *ppa)
 		struct nand_cmd gcr = {
 			.type = GC_IO,
 			.cmd = NAND_READ,
-			.stime = 0,
+			.stime = nsecs_start,
 			.xfer_size = spp->pgsz,
 			.interleave_pci_dma = false,
 			.ppa = ppa,
 		};
-		ssd_advance_nand(conv_ftl->ssd, &gcr);
+		return ssd_advance_nand(conv_ftl->ssd, &gcr);
 	}
+
+	return nsecs_start;
 }
 
-/* move valid page data (already in DRAM) from victim line to a new page */
-static uint64_t gc_write_page(struct conv_ftl *conv_ftl, struct ppa *old_ppa)
+static inline bool same_plane(struct ppa *ppa1, struct ppa *ppa2)
+{
+	return ppa1->g.ch == ppa2->g.ch && ppa1->g.lun == ppa2->g.lun && ppa1->g.pl == ppa2->g.pl;
+}
+
+/*
+ * move valid page data (read at nsecs_ready) from victim line to a new page.
+ * The program is issued once the oneshot page of gc_wp is filled.
+ */
+static uint64_t gc_write_page(struct conv_ftl *conv_ftl, struct ppa *old_ppa,
+			      uint64_t nsecs_ready)
 {
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct convparams *cpp = &conv_ftl->cp;
 	struct ppa new_ppa;
 	uint64_t lpn = get_rmap_ent(conv_ftl, old_ppa);
 
-	NVMEV_ASSERT(valid_lpn(conv_ftl, lpn));
 	new_ppa = get_new_page(conv_ftl, GC_IO);
-	/* update maptbl */
-	set_maptbl_ent(conv_ftl, lpn, &new_ppa);
+	if (is_tpage_lpn(lpn)) {
+		/* a translation page only moves in the GTD */
+		conv_ftl->cmt.gtd[TPAGE_TPN(lpn)] = new_ppa;
+	} else {
+		NVMEV_ASSERT(valid_lpn(conv_ftl, lpn));
+		/* update maptbl */
+		set_maptbl_ent(conv_ftl, lpn, &new_ppa);
+	}
 	/* update rmap */
 	set_rmap_ent(conv_ftl, lpn, &new_ppa);
 
@@ -647,21 +1120,22 @@ static uint64_t gc_write_page(struct conv_ftl *conv_ftl, struct ppa *old_ppa)
 	advance_write_pointer(conv_ftl, GC_IO);
 
 	if (cpp->enable_gc_delay) {
-		struct nand_cmd gcw = {
-			.type = GC_IO,
-			.cmd = NAND_NOP,
-			.stime = 0,
-			.interleave_pci_dma = false,
-			.ppa = &new_ppa,
-		};
-		if (last_pg_in_wordline(conv_ftl, &new_ppa)) {
-			gcw.cmd = NAND_WRITE;
-			gcw.xfer_size = spp->pgsz * spp->pgs_per_oneshotpg;
+		if (!cpp->enable_copyback) {
+			conv_ftl->gc_xfer_pgs++;
+		} else if (!same_plane(old_ppa, &new_ppa)) {
+			/* copyback is not possible, the page leaves the die */
+			nsecs_ready = chmodel_request(get_ch(conv_ftl->ssd, old_ppa)->perf_model,
+						      nsecs_ready, spp->pgsz);
+			conv_ftl->gc_xfer_pgs++;
 		}
-
-		ssd_advance_nand(conv_ftl->ssd, &gcw);
+		conv_ftl->gc_ready_time = max(conv_ftl->gc_ready_time, nsecs_ready);
+		gc_program_wordline(conv_ftl, &new_ppa);
 	}
 
+	/* the map update may write back a translation page through gc_wp */
+	if (!is_tpage_lpn(lpn))
+		map_access(conv_ftl, lpn, true, nsecs_ready);
+
 	/* advance per-ch gc_endtime as well */
 #if 0
 	new_ch = get_ch(conv_ftl, &new_ppa);
@@ -698,7 +1172,7 @@ static struct line *select_victim_line(struct conv_ftl *conv_ftl, bool force)
 }
 
 /* here ppa identifies the block we want to clean */
-static void clean_one_block(struct conv_ftl *conv_ftl, struct ppa *ppa)
+static void clean_one_block(struct conv_ftl *conv_ftl, struct ppa *ppa, uint64_t nsecs_start)
 {
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct nand_page *pg_iter = NULL;
@@ -711,9 +1185,9 @@ static void clean_one_block(struct conv_ftl *conv_ftl, struct ppa *ppa)
 		/* there shouldn't be any free page in victim blocks */
 		NVMEV_ASSERT(pg_iter->status != PG_FREE);
 		if (pg_iter->status == PG_VALID) {
-			gc_read_page(conv_ftl, ppa);
+			uint64_t nsecs_ready = gc_read_page(conv_ftl, ppa, nsecs_start);
 			/* delay the maptbl update until "write" happens */
-			gc_write_page(conv_ftl, ppa);
+			gc_write_page(conv_ftl, ppa, nsecs_ready);
 			cnt++;
 		}
 	}
@@ -721,14 +1195,17 @@ static void clean_one_block(struct conv_ftl *conv_ftl, struct ppa *ppa)
 	NVMEV_ASSERT(get_blk(conv_ftl->ssd, ppa)->vpc == cnt);
 }
 
-/* here ppa identifies the block we want to clean */
-static void clean_one_flashpg(struct conv_ftl *conv_ftl, struct ppa *ppa)
+/*
+ * here ppa identifies the flash page we want to clean. Returns when the valid
+ * data of the flash page has been read out.
+ */
+static uint64_t clean_one_flashpg(struct conv_ftl *conv_ftl, struct ppa *ppa, uint64_t nsecs_start)
 {
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct convparams *cpp = &conv_ftl->cp;
 	struct nand_page *pg_iter = NULL;
 	int cnt = 0, i = 0;
-	uint64_t completed_time = 0;
+	uint64_t completed_time = nsecs_start;
 	struct ppa ppa_copy = *ppa;
 
 	for (i = 0; i < spp->pgs_per_flashpg; i++) {
@@ -744,14 +1221,15 @@ static void clean_one_flashpg(struct conv_ftl *conv_ftl, struct ppa *ppa)
 	ppa_copy = *ppa;
 
 	if (cnt <= 0)
-		return;
+		return completed_time;
 
 	if (cpp->enable_gc_delay) {
+		/* with copyback the data stays in the page register */
 		struct nand_cmd gcr = {
 			.type = GC_IO,
 			.cmd = NAND_READ,
-			.stime = 0,
-			.xfer_size = spp->pgsz * cnt,
+			.stime = nsecs_start,
+			.xfer_size = cpp->enable_copyback ? 0 : spp->pgsz * cnt,
 			.interleave_pci_dma = false,
 			.ppa = &ppa_copy,
 		};
@@ -764,11 +1242,13 @@ static void clean_one_flashpg(struct conv_ftl *conv_ftl, struct ppa *ppa)
 		/* there shouldn't be any free page in victim blocks */
 		if (pg_iter->status == PG_VALID) {
 			/* delay the maptbl update until "write" happens */
-			gc_write_page(conv_ftl, &ppa_copy);
+			gc_write_page(conv_ftl, &ppa_copy, completed_time);
 		}
 
 		ppa_copy.g.pg++;
 	}
+
+	return completed_time;
 }
 
 static void mark_line_free(struct conv_ftl *conv_ftl, struct ppa *ppa)
@@ -777,62 +1257,74 @@ static void mark_line_free(struct conv_ftl *conv_ftl, struct ppa *ppa)
 	struct line *line = get_line(conv_ftl, ppa);
 	line->ipc = 0;
 	line->vpc = 0;
+	if (line->slc) {
+		line->slc = false;
+		lm->slc_line_cnt--;
+	}
 	/* move this line to free line list */
 	list_add_tail(&line->entry, &lm->free_line_list);
 	lm->free_line_cnt++;
 }
 
-static int do_gc(struct conv_ftl *conv_ftl, bool force)
+/*
+ * GC is modelled as a pipelined stream starting at nsecs_start: each flash page
+ * of the victim line is read from all LUNs in parallel, valid data is programmed
+ * per oneshot page onto gc_wp as soon as it has been read, and each block is
+ * erased after its last read.
+ */
+static void clean_one_line(struct conv_ftl *conv_ftl, struct line *victim_line,
+			   uint64_t nsecs_start)
 {
-	struct line *victim_line = NULL;
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	uint32_t flashpgs = line_pgs_per_blk(conv_ftl, victim_line) / spp->pgs_per_flashpg;
 	struct ppa ppa;
 	int flashpg;
 
-	victim_line = select_victim_line(conv_ftl, force);
-	if (!victim_line) {
-		return -1;
-	}
-
+	ppa.ppa = 0;
 	ppa.g.blk = victim_line->id;
-	NVMEV_DEBUG_VERBOSE("GC-ing line:%d,ipc=%d(%d),victim=%d,full=%d,free=%d\n", ppa.g.blk,
-		    victim_line->ipc, victim_line->vpc, conv_ftl->lm.victim_line_cnt,
-		    conv_ftl->lm.full_line_cnt, conv_ftl->lm.free_line_cnt);
+	NVMEV_DEBUG_VERBOSE("GC-ing line:%d,ipc=%d(%d),slc=%d,victim=%d,full=%d,free=%d\n",
+		    ppa.g.blk, victim_line->ipc, victim_line->vpc, victim_line->slc,
+		    conv_ftl->lm.victim_line_cnt, conv_ftl->lm.full_line_cnt,
+		    conv_ftl->lm.free_line_cnt);
 
-	conv_ftl->wfc.credits_to_refill = victim_line->ipc;
+	/* pages the freed line adds on top of what its valid data takes */
+	conv_ftl->wfc.credits_to_refill = spp->pgs_per_line - victim_line->vpc;
 
 	/* copy back valid data */
-	for (flashpg = 0; flashpg < spp->flashpgs_per_blk; flashpg++) {
-		int ch, lun;
+	for (flashpg = 0; flashpg < flashpgs; flashpg++) {
+		int ch, lun, pl;
+		uint64_t nsecs_read;
 
 		ppa.g.pg = flashpg * spp->pgs_per_flashpg;
 		for (ch = 0; ch < spp->nchs; ch++) {
 			for (lun = 0; lun < spp->luns_per_ch; lun++) {
-				struct nand_lun *lunp;
-
-				ppa.g.ch = ch;
-				ppa.g.lun = lun;
-				ppa.g.pl = 0;
-				lunp = get_lun(conv_ftl->ssd, &ppa);
-				clean_one_flashpg(conv_ftl, &ppa);
-
-				if (flashpg == (spp->flashpgs_per_blk - 1)) {
-					struct convparams *cpp = &conv_ftl->cp;
-
-					mark_block_free(conv_ftl, &ppa);
-
-					if (cpp->enable_gc_delay) {
-						struct nand_cmd gce = {
-							.type = GC_IO,
-							.cmd = NAND_ERASE,
-							.stime = 0,
-							.interleave_pci_dma = false,
-							.ppa = &ppa,
-						};
-						ssd_advance_nand(conv_ftl->ssd, &gce);
+				for (pl = 0; pl < spp->pls_per_lun; pl++) {
+					struct nand_lun *lunp;
+
+					ppa.g.ch = ch;
+					ppa.g.lun = lun;
+					ppa.g.pl = pl;
+					lunp = get_lun(conv_ftl->ssd, &ppa);
+					nsecs_read = clean_one_flashpg(conv_ftl, &ppa, nsecs_start);
+
+					if (flashpg == (flashpgs - 1)) {
+						struct convparams *cpp = &conv_ftl->cp;
+
+						mark_block_free(conv_ftl, &ppa);
+
+						if (cpp->enable_gc_delay) {
+							struct nand_cmd gce = {
+								.type = GC_IO,
+								.cmd = NAND_ERASE,
+								.stime = nsecs_read,
+								.interleave_pci_dma = false,
+								.ppa = &ppa,
+							};
+							ssd_advance_nand(conv_ftl->ssd, &gce);
+						}
+
+						lunp->gc_endtime = lunp->next_lun_avail_time;
 					}
-
-					lunp->gc_endtime = lunp->next_lun_avail_time;
 				}
 			}
 		}
@@ -840,16 +1332,64 @@ static int do_gc(struct conv_ftl *conv_ftl, bool force)
 
 	/* update line status */
 	mark_line_free(conv_ftl, &ppa);
+}
+
+static int do_gc(struct conv_ftl *conv_ftl, bool force, uint64_t nsecs_start)
+{
+	struct line *victim_line = select_victim_line(conv_ftl, force);
+
+	if (!victim_line) {
+		return -1;
+	}
+
+	clean_one_line(conv_ftl, victim_line, nsecs_start);
+
+	return 0;
+}
+
+/* fold the oldest SLC line into native lines through the GC write pointer */
+static int fold_slc_line(struct conv_ftl *conv_ftl, uint64_t nsecs_start)
+{
+	struct line *line = list_first_entry_or_null(&conv_ftl->lm.slc_line_list, struct line,
+						     entry);
+
+	if (!line) {
+		return -1;
+	}
+
+	list_del_init(&line->entry);
+	clean_one_line(conv_ftl, line, nsecs_start);
 
 	return 0;
 }
 
-static void foreground_gc(struct conv_ftl *conv_ftl)
+/*
+ * Fold the whole SLC cache once the partition has been idle long enough. The
+ * folded data needs native lines of its own, so folding stops once free lines
+ * run down to the GC threshold and foreground GC takes over from there.
+ */
+static void fold_slc_lines_on_idle(struct conv_ftl *conv_ftl, uint64_t nsecs_start)
+{
+	struct convparams *cpp = &conv_ftl->cp;
+	uint64_t nsecs_idle = conv_ftl->last_flush_time + cpp->slc_fold_idle;
+
+	if (list_empty(&conv_ftl->lm.slc_line_list) || nsecs_idle > nsecs_start)
+		return;
+
+	while (!should_gc(conv_ftl) && fold_slc_line(conv_ftl, nsecs_idle) == 0)
+		;
+}
+
+static void foreground_gc(struct conv_ftl *conv_ftl, uint64_t nsecs_start)
 {
 	if (should_gc_high(conv_ftl)) {
 		NVMEV_DEBUG_VERBOSE("should_gc_high passed");
+		/* folding the SLC cache reclaims a whole line at the cost of its valid data */
+		if (fold_slc_line(conv_ftl, nsecs_start) == 0)
+			return;
+
 		/* perform GC here until !should_gc(conv_ftl) */
-		do_gc(conv_ftl, true);
+		do_gc(conv_ftl, true, nsecs_start);
 	}
 }
 
@@ -862,6 +1402,180 @@ static bool is_same_flash_page(struct conv_ftl *conv_ftl, struct ppa ppa1, struc
 	return (ppa1.h.blk_in_ssd == ppa2.h.blk_in_ssd) && (ppa1_page == ppa2_page);
 }
 
+/* the read cache is indexed by the first page of a flash page */
+static inline struct ppa rc_key(struct conv_ftl *conv_ftl, struct ppa ppa)
+{
+	ppa.g.pg -= ppa.g.pg % conv_ftl->ssd->sp.pgs_per_flashpg;
+	return ppa;
+}
+
+static inline struct hlist_head *rc_bucket(struct read_cache *rc, struct ppa key)
+{
+	return &rc->buckets[hash_64(key.ppa, rc->hash_bits)];
+}
+
+static struct read_cache_entry *rc_lookup(struct conv_ftl *conv_ftl, struct ppa *ppa)
+{
+	struct read_cache *rc = &conv_ftl->rc;
+	struct ppa key = rc_key(conv_ftl, *ppa);
+	struct read_cache_entry *entry;
+
+	if (!rc->nr_entries)
+		return NULL;
+
+	hlist_for_each_entry(entry, rc_bucket(rc, key), hnode) {
+		if (entry->ppa.ppa == key.ppa)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void rc_insert(struct conv_ftl *conv_ftl, struct ppa *ppa, uint64_t ready_time,
+		      bool prefetched)
+{
+	struct read_cache *rc = &conv_ftl->rc;
+	struct read_cache_entry *entry = rc_lookup(conv_ftl, ppa);
+
+	if (!entry) {
+		/* CLOCK: evict the first entry without a reference bit */
+		while (rc->entries[rc->hand].ref) {
+			rc->entries[rc->hand].ref = false;
+			rc->hand = (rc->hand + 1) % rc->nr_entries;
+		}
+		entry = &rc->entries[rc->hand];
+		rc->hand = (rc->hand + 1) % rc->nr_entries;
+
+		hlist_del_init(&entry->hnode);
+		entry->ppa = rc_key(conv_ftl, *ppa);
+		hlist_add_head(&entry->hnode, rc_bucket(rc, entry->ppa));
+	}
+
+	entry->ready_time = ready_time;
+	entry->ref = false;
+	entry->prefetched = prefetched;
+}
+
+/* the data of an erased block is gone, drop its flash pages from the cache */
+static void rc_invalidate_block(struct conv_ftl *conv_ftl, struct ppa *ppa)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct read_cache_entry *entry;
+	struct ppa key = *ppa;
+	uint32_t pg;
+
+	if (!conv_ftl->rc.nr_entries)
+		return;
+
+	for (pg = 0; pg < spp->pgs_per_blk; pg += spp->pgs_per_flashpg) {
+		key.g.pg = pg;
+		entry = rc_lookup(conv_ftl, &key);
+		if (!entry)
+			continue;
+
+		hlist_del_init(&entry->hnode);
+		entry->ppa.ppa = UNMAPPED_PPA;
+		entry->ref = false;
+		entry->prefetched = false;
+	}
+}
+
+/*
+ * Detect a sequential stream per partition and read the following flash pages
+ * into the read cache. Read-ahead is issued behind the demand reads.
+ */
+static void rc_read_ahead(struct conv_ftl *conv_ftl, uint64_t first_lpn, uint64_t last_lpn,
+			  uint64_t nsecs_start)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct convparams *cpp = &conv_ftl->cp;
+	struct read_cache *rc = &conv_ftl->rc;
+	uint64_t flashpg, lpn;
+	struct nand_cmd sra = {
+		.type = USER_IO,
+		.cmd = NAND_READ,
+		.stime = nsecs_start,
+		.xfer_size = spp->pgsz * spp->pgs_per_flashpg,
+		.interleave_pci_dma = false,
+	};
+	int i;
+
+	if (first_lpn == rc->next_lpn)
+		rc->seq_cnt++;
+	else
+		rc->seq_cnt = 0;
+	rc->next_lpn = last_lpn + 1;
+
+	if (rc->seq_cnt < cpp->ra_trigger)
+		return;
+
+	flashpg = last_lpn / spp->pgs_per_flashpg + 1;
+	for (i = 0; i < cpp->ra_flashpgs; i++, flashpg++) {
+		struct ppa ppa;
+
+		lpn = flashpg * spp->pgs_per_flashpg;
+		if (!valid_lpn(conv_ftl, lpn))
+			break;
+
+		ppa = get_maptbl_ent(conv_ftl, lpn);
+		if (!mapped_ppa(&ppa) || !valid_ppa(conv_ftl, &ppa) || rc_lookup(conv_ftl, &ppa))
+			continue;
+
+		ppa = rc_key(conv_ftl, ppa);
+		sra.ppa = &ppa;
+		rc_insert(conv_ftl, &ppa, ssd_advance_nand(conv_ftl->ssd, &sra), true);
+		atomic64_inc(&nvmev_vdev->ra_issued);
+	}
+}
+
+/*
+ * Issue a batch of planned reads round by round, so that every LUN gets its
+ * first sense before any LUN gets its second one. Sensing on different LUNs
+ * thus overlaps with the channel transfers. The ops are bucketed by round in
+ * a single pass.
+ */
+static uint64_t conv_read_issue(struct conv_ftl *conv_ftls, struct nand_cmd *srd,
+				uint32_t nr_ops, uint32_t nr_rounds, bool use_rc)
+{
+	struct ssdparams *spp = &conv_ftls[0].ssd->sp;
+	struct conv_read_ops *ro = &conv_ftls[0].ro;
+	uint64_t nsecs_completed, nsecs_latest = srd->stime;
+	uint32_t i, r;
+
+	memset(ro->round_cnt, 0, sizeof(uint32_t) * (nr_rounds + 1));
+	for (i = 0; i < nr_ops; i++)
+		ro->round_cnt[ro->ops[i].round + 1]++;
+	for (r = 1; r <= nr_rounds; r++)
+		ro->round_cnt[r] += ro->round_cnt[r - 1];
+	for (i = 0; i < nr_ops; i++)
+		ro->order[ro->round_cnt[ro->ops[i].round]++] = i;
+
+	for (i = 0; i < nr_ops; i++) {
+		struct conv_read_op *op = &ro->ops[ro->order[i]];
+		struct conv_ftl *conv_ftl = &conv_ftls[op->ftl_idx];
+
+		srd->xfer_size = op->xfer_size;
+		srd->ppa = &op->ppa;
+		nsecs_completed = ssd_advance_nand(conv_ftl->ssd, srd);
+		nsecs_latest = max(nsecs_completed, nsecs_latest);
+
+		/* keep whole flash pages that went through the controller */
+		if (use_rc && srd->xfer_size == spp->pgsz * spp->pgs_per_flashpg)
+			rc_insert(conv_ftl, &op->ppa, nsecs_completed, false);
+
+		conv_ftl->ro.lun_ops[op->ppa.g.ch * spp->luns_per_ch + op->ppa.g.lun] = 0;
+	}
+
+	return nsecs_latest;
+}
+
+/*
+ * The reads of a command are planned first, one op per flash page, and then
+ * issued by conv_read_issue(). A command longer than a batch is planned and
+ * issued batch by batch. Firmware overhead is charged once per command, and
+ * every page waits for its mapping entry, whether it is read from NAND, the
+ * read cache or the write buffer.
+ */
 static bool conv_read(struct nvmev_ns *ns, struct nvmev_request *req, struct nvmev_result *ret)
 {
 	struct conv_ftl *conv_ftls = (struct conv_ftl *)ns->ftls;
@@ -878,17 +1592,23 @@ static bool conv_read(struct nvmev_ns *ns, struct nvmev_request *req, struct nvm
 	uint64_t end_lpn = (lba + nr_lba - 1) / spp->secs_per_pg;
 	uint64_t nsecs_start = req->nsecs_start;
 	uint64_t nsecs_completed, nsecs_latest = nsecs_start;
-	uint32_t xfer_size, i;
+	uint64_t lpn;
 	uint32_t nr_parts = ns->nr_parts;
-	uint32_t ssd_read_cnt = 0;
-	size_t buffered_block_cnt = 0;
-	int pgs_per_flashpg = spp->pgs_per_flashpg;
+	uint32_t status = NVME_SC_SUCCESS;
+	uint32_t pg_xfer_size = min_t(uint64_t, spp->pgsz, LBA_TO_BYTE(nr_lba));
+	uint32_t nr_buffered = 0, nr_cached = 0;
+	uint64_t nsecs_cached = nsecs_start;
+	uint64_t nsecs_xlat = nsecs_start; /* mapping entries of the command available */
+	uint32_t nr_ops = 0, nr_rounds = 0, i;
+	int open_op[SSD_MAX_PARTITIONS];
+	uint64_t first_lpn[SSD_MAX_PARTITIONS], last_lpn[SSD_MAX_PARTITIONS];
+	bool use_rc = (conv_ftl->rc.nr_entries > 0);
+	struct conv_read_op *ops = conv_ftl->ro.ops;
+	uint64_t nsecs_fw;
 
-	struct ppa prev_ppa;
 	struct nand_cmd srd = {
 		.type = USER_IO,
 		.cmd = NAND_READ,
-		.stime = nsecs_start,
 		.interleave_pci_dma = true,
 	};
 
@@ -900,87 +1620,135 @@ static bool conv_read(struct nvmev_ns *ns, struct nvmev_request *req, struct nvm
 		return false;
 	}
 
-	// interleaving read requests over all parts
-	for (i = 0; (i < nr_parts) && (start_lpn <= end_lpn); i++, start_lpn += pgs_per_flashpg) {
-		xfer_size = 0;
-		int ftl_idx = GET_FTL_IDX(start_lpn);
+	/* firmware overhead, once per command */
+	if (LBA_TO_BYTE(nr_lba) <= KB(4))
+		nsecs_fw = nsecs_start + spp->fw_4kb_rd_lat;
+	else
+		nsecs_fw = nsecs_start + spp->fw_rd_lat;
+
+	for (i = 0; i < nr_parts; i++) {
+		open_op[i] = -1;
+		first_lpn[i] = INVALID_LPN;
+	}
+
+	/* plan: one op per flash page, buffered and unmapped pages need no NAND read */
+	for (lpn = start_lpn; lpn <= end_lpn; lpn++) {
+		uint32_t ftl_idx = GET_FTL_IDX(lpn);
+		uint64_t local_lpn = LOCAL_LPN(lpn);
+		struct ppa cur_ppa;
+
 		conv_ftl = &conv_ftls[ftl_idx];
 		wbuf = &conv_ftl->ssd->write_buffer;
-		prev_ppa = get_maptbl_ent(conv_ftl, LOCAL_LPN(start_lpn));
+		nsecs_xlat = max(nsecs_xlat, map_access(conv_ftl, local_lpn, false, nsecs_start));
+		cur_ppa = get_maptbl_ent(conv_ftl, local_lpn);
 
-		uint64_t local_start_lpn = start_lpn;
-		
-		// jump to the next flash page of the current part(4 flash pages)
-		for (; local_start_lpn <= end_lpn; local_start_lpn += pgs_per_flashpg * nr_parts) {
-			// local_end_lpn is the last lpn in the current flash page or the end of the request
-			uint64_t local_end_lpn = min(end_lpn, local_start_lpn + pgs_per_flashpg - 1);
-			for (uint64_t lpn = local_start_lpn; lpn <= local_end_lpn; lpn++) {
-				uint64_t local_lpn = LOCAL_LPN(lpn);
-
-				struct ppa cur_ppa = get_maptbl_ent(conv_ftl, local_lpn);
-				if (!mapped_ppa(&cur_ppa) || !valid_ppa(conv_ftl, &cur_ppa)) {
-					NVMEV_DEBUG_VERBOSE("lpn 0x%llx not mapped to valid ppa\n", local_lpn);
-					NVMEV_DEBUG_VERBOSE("Invalid ppa,ch:%d,lun:%d,blk:%d,pl:%d,pg:%d\n",
-							    cur_ppa.g.ch, cur_ppa.g.lun, cur_ppa.g.blk,
-							    cur_ppa.g.pl, cur_ppa.g.pg);
-					continue;
-				}
+		if (first_lpn[ftl_idx] == INVALID_LPN)
+			first_lpn[ftl_idx] = local_lpn;
+		last_lpn[ftl_idx] = local_lpn;
 
-				// if the lpn is in the write buffer, advance the write buffer, not the NAND
-				if (buffer_search(wbuf, lpn) != NULL) {
-					nsecs_completed = ssd_advance_write_buffer(conv_ftl->ssd, nsecs_start, LBA_TO_BYTE(nr_lba));
-					nsecs_latest = max(nsecs_completed, nsecs_latest);
-					continue;
-				}
+		if (uncor_ppa(&cur_ppa) && buffer_search(wbuf, lpn) == NULL) {
+			NVMEV_DEBUG_VERBOSE("lpn 0x%llx marked uncorrectable\n", local_lpn);
+			status = NVME_SC_READ_ERROR;
+			continue;
+		}
 
-				// aggregate read io in same flash page
-				if (mapped_ppa(&prev_ppa) &&
-				    is_same_flash_page(conv_ftl, cur_ppa, prev_ppa) && (lpn != start_lpn)) {
-					xfer_size += spp->pgsz;
-					continue;
-				}
+		if (!mapped_ppa(&cur_ppa) || !valid_ppa(conv_ftl, &cur_ppa)) {
+			NVMEV_DEBUG_VERBOSE("lpn 0x%llx not mapped to valid ppa\n", local_lpn);
+			NVMEV_DEBUG_VERBOSE("Invalid ppa,ch:%d,lun:%d,blk:%d,pl:%d,pg:%d\n",
+					    cur_ppa.g.ch, cur_ppa.g.lun, cur_ppa.g.blk,
+					    cur_ppa.g.pl, cur_ppa.g.pg);
+			continue;
+		}
 
-				if (xfer_size > 0) {
-					srd.xfer_size = xfer_size;
-					srd.ppa = &prev_ppa;
-					if (xfer_size <= KB(4)) {
-						srd.stime = spp->fw_4kb_rd_lat + nsecs_start;
-					} else {
-						srd.stime = spp->fw_rd_lat + nsecs_start;
-					}
-					// NVMEV_INFO("FW Read Latency: %llu\n", srd.stime - nsecs_start);
-					// NVMEV_INFO("Read Occur: %d, %d, %d, %d, %d - xfer size: %u", prev_ppa.g.ch, prev_ppa.g.lun, prev_ppa.g.blk, prev_ppa.g.pl, prev_ppa.g.pg, xfer_size);
-					nsecs_completed = ssd_advance_nand(conv_ftl->ssd, &srd);
-					nsecs_latest = max(nsecs_completed, nsecs_latest);
-				}
+		// if the lpn is in the write buffer, advance the write buffer, not the NAND
+		if (buffer_search(wbuf, lpn) != NULL) {
+			nr_buffered++;
+			continue;
+		}
 
-				if (spp->pgsz > LBA_TO_BYTE(nr_lba)) {
-					// single page read, yet smaller than mapping page size
-					xfer_size = LBA_TO_BYTE(nr_lba);
-				} else {
-					xfer_size = spp->pgsz;
-				}
-				prev_ppa = cur_ppa;
-			}
+		if (use_rc) {
+			struct read_cache_entry *entry = rc_lookup(conv_ftl, &cur_ppa);
 
-			if (xfer_size > 0) {
-				srd.xfer_size = xfer_size;
-				srd.ppa = &prev_ppa;
-				if (xfer_size <= KB(4)) {
-					srd.stime = spp->fw_4kb_rd_lat + nsecs_start;
-				} else {
-					srd.stime = spp->fw_rd_lat + nsecs_start;
+			if (entry) {
+				if (entry->prefetched) {
+					atomic64_inc(&nvmev_vdev->ra_useful);
+					entry->prefetched = false;
 				}
-				// NVMEV_INFO("FW Read Latency: %llu\n", srd.stime - nsecs_start);
-				// NVMEV_INFO("Read Occur: %d, %d, %d, %d, %d - xfer size: %u", prev_ppa.g.ch, prev_ppa.g.lun, prev_ppa.g.blk, prev_ppa.g.pl, prev_ppa.g.pg, xfer_size);
-				nsecs_completed = ssd_advance_nand(conv_ftl->ssd, &srd);
-				nsecs_latest = max(nsecs_completed, nsecs_latest);
+				entry->ref = true;
+				nsecs_cached = max(nsecs_cached, entry->ready_time);
+				nr_cached++;
+				atomic64_inc(&nvmev_vdev->rc_hits);
+				continue;
 			}
+			atomic64_inc(&nvmev_vdev->rc_misses);
+		}
+
+		// aggregate read io in same flash page
+		if (open_op[ftl_idx] >= 0 &&
+		    is_same_flash_page(conv_ftl, cur_ppa, ops[open_op[ftl_idx]].ppa)) {
+			ops[open_op[ftl_idx]].xfer_size += spp->pgsz;
+			continue;
+		}
+
+		if (nr_ops == conv_ftls[0].ro.max_ops) {
+			/* NAND reads cannot start before their mapping entries are fetched */
+			srd.stime = max(nsecs_fw, nsecs_xlat);
+			nsecs_latest = max(nsecs_latest,
+					   conv_read_issue(conv_ftls, &srd, nr_ops, nr_rounds, use_rc));
+			nr_ops = nr_rounds = 0;
+			for (i = 0; i < nr_parts; i++)
+				open_op[i] = -1;
 		}
+
+		ops[nr_ops].ftl_idx = ftl_idx;
+		ops[nr_ops].xfer_size = pg_xfer_size;
+		ops[nr_ops].ppa = cur_ppa;
+		ops[nr_ops].round =
+			conv_ftl->ro.lun_ops[cur_ppa.g.ch * spp->luns_per_ch + cur_ppa.g.lun]++;
+		nr_rounds = max(nr_rounds, ops[nr_ops].round + 1);
+		open_op[ftl_idx] = nr_ops++;
+	}
+
+	/* translation is on the path of every page, buffered or not */
+	nsecs_latest = max(nsecs_latest, nsecs_xlat);
+
+	if (nr_buffered > 0) {
+		nsecs_completed = ssd_advance_write_buffer(
+			ssd, nsecs_start, min_t(uint64_t, LBA_TO_BYTE(nr_lba), nr_buffered * spp->pgsz));
+		nsecs_latest = max(nsecs_completed, nsecs_latest);
+	}
+
+	/* read cache hits complete at DRAM speed once their data has arrived */
+	if (nr_cached > 0) {
+		nsecs_completed = ssd_advance_write_buffer(
+			ssd, nsecs_start, min_t(uint64_t, LBA_TO_BYTE(nr_lba), nr_cached * spp->pgsz));
+		nsecs_latest = max3(nsecs_completed, nsecs_cached, nsecs_latest);
 	}
-	
+
+	/* NAND reads cannot start before their mapping entries are fetched */
+	srd.stime = max(nsecs_fw, nsecs_xlat);
+	if (nr_ops > 0)
+		nsecs_latest = max(nsecs_latest,
+				   conv_read_issue(conv_ftls, &srd, nr_ops, nr_rounds, use_rc));
+
+	if (use_rc) {
+		for (i = 0; i < nr_parts; i++) {
+			if (first_lpn[i] != INVALID_LPN)
+				rc_read_ahead(&conv_ftls[i], first_lpn[i], last_lpn[i], srd.stime);
+		}
+	}
+
+	/*
+	 * A CMT miss may have written back a dirty translation page. GC would move
+	 * or erase the pages planned above, so it only runs once they are issued.
+	 */
+	for (i = 0; i < nr_parts; i++) {
+		if (first_lpn[i] != INVALID_LPN)
+			check_and_refill_write_credit(&conv_ftls[i], nsecs_start);
+	}
+
 	ret->nsecs_target = nsecs_latest;
-	ret->status = NVME_SC_SUCCESS;
+	ret->status = status;
 
 	// NVMEV_INFO("Total Read Latency: %llu\n", nsecs_latest - nsecs_start);
 
@@ -988,7 +1756,41 @@ static bool conv_read(struct nvmev_ns *ns, struct nvmev_request *req, struct nvm
 }
 
 
-static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, uint64_t nsecs_rmw_start)
+/*
+ * A short program (a forced or partly discarded PPG) leaves the user wp inside
+ * a flash page. Fill the rest of it with invalid pages so that every program
+ * covers exactly one flash page on one ch/lun. Returns the number of pads.
+ */
+static uint32_t pad_flash_page(struct conv_ftl *conv_ftl, uint64_t nsecs_start)
+{
+	struct ssdparams *spp = &conv_ftl->ssd->sp;
+	struct write_pointer *wp = __get_wp(conv_ftl, USER_IO);
+	uint32_t nr_pads = 0;
+	struct ppa ppa;
+
+	while (wp->pg % spp->pgs_per_flashpg) {
+		ppa = get_new_page(conv_ftl, USER_IO);
+		set_rmap_ent(conv_ftl, INVALID_LPN, &ppa);
+		mark_page_valid(conv_ftl, &ppa);
+		mark_page_invalid(conv_ftl, &ppa);
+		advance_write_pointer(conv_ftl, USER_IO);
+
+		consume_write_credit(conv_ftl);
+		check_and_refill_write_credit(conv_ftl, nsecs_start);
+		nr_pads++;
+	}
+
+	return nr_pads;
+}
+
+/* a PPG goes to NAND once full, or with whatever it holds when forced by Flush */
+static inline bool ppg_to_flush(struct buffer *wbuf, struct buffer_ppg *ppg, bool force)
+{
+	return ppg->valid && (ppg->pg_idx == wbuf->pg_per_ppg || (force && ppg->pg_idx > 0));
+}
+
+static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, uint64_t nsecs_rmw_start,
+			 bool force)
 {
 	// NVMEV_INFO("RMW Start\n");
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
@@ -1012,6 +1814,8 @@ static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, u
 		.xfer_size = spp->pgsz,
 	};
 
+	fold_slc_lines_on_idle(conv_ftl, nsecs_rmw_start);
+
 	/* read phase of read-modify-write operation fill empty cell of write buffer */
 	// NVMEV_INFO("Flush buffer(%d) free_ppgs: %lu, used_ppgs: %lu\n", wbuf->ftl_idx,
 	// 	    list_count_nodes(&wbuf->free_ppgs), list_count_nodes(&wbuf->used_ppgs));
@@ -1021,18 +1825,24 @@ static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, u
 	struct ppa ppa;
 	int32_t xfer_size = 0;
 	list_for_each_entry(ppg, &wbuf->used_ppgs, list) {
-		if(!ppg->valid || ppg->pg_idx != wbuf->pg_per_ppg) {
+		if (!ppg_to_flush(wbuf, ppg, force)) {
 			continue;
 		}
 		
 		size_t ftl_idx = wbuf->ftl_idx;
 		uint64_t lpn = INVALID_LPN;
 		uint64_t local_lpn = INVALID_LPN;
-		prev_ppa = get_maptbl_ent(conv_ftl, LOCAL_LPN(ppg->pages[0].lpn));
+		prev_ppa.ppa = UNMAPPED_PPA;
 
 		for (size_t j = 0; j < wbuf->pg_per_ppg; j++) {
 			page = &ppg->pages[j];
 			lpn = page->lpn;
+
+			/* discarded by write zeroes / write uncorrectable */
+			if (lpn == INVALID_LPN) {
+				continue;
+			}
+
 			local_lpn = LOCAL_LPN(lpn);
 			ppa = get_maptbl_ent(conv_ftl, local_lpn);
 
@@ -1076,12 +1886,13 @@ static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, u
 
 	/* write phase of read-modify-write operation */
 	list_for_each_entry(ppg, &wbuf->used_ppgs, list) {
-		if (!ppg->valid || ppg->pg_idx != wbuf->pg_per_ppg) {
+		if (!ppg_to_flush(wbuf, ppg, force)) {
 			continue;
 		}
 
 		ppg->valid = false;
 		struct ppa ppa;
+		uint32_t nr_pgs = 0;
 
 		/* Assumption: all pages in physical buffer page */
 		for (size_t j = 0; j < wbuf->pg_per_ppg; j++) {
@@ -1105,6 +1916,7 @@ static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, u
 			ppa = get_new_page(conv_ftl, USER_IO);
 			/* update maptbl */
 			set_maptbl_ent(conv_ftl, local_lpn, &ppa);
+			map_access(conv_ftl, local_lpn, true, nsecs_write_start);
 			NVMEV_DEBUG("%s: got new ppa %lld, ", __func__, ppa2pgidx(conv_ftl, &ppa));
 			/* update rmap */
 			set_rmap_ent(conv_ftl, local_lpn, &ppa);
@@ -1115,20 +1927,32 @@ static uint64_t conv_rmw(struct conv_ftl *conv_ftl, struct nvmev_request *req, u
 			advance_write_pointer(conv_ftl, USER_IO);
 				
 			consume_write_credit(conv_ftl);
-			check_and_refill_write_credit(conv_ftl);
+			check_and_refill_write_credit(conv_ftl, nsecs_write_start);
+			nr_pgs++;
+		}
+
+		/* every page was discarded, there is nothing to program */
+		if (!nr_pgs) {
+			ppg->complete_time = nsecs_write_start;
+			schedule_internal_operation(req->sq_id, nsecs_write_start, wbuf);
+			continue;
 		}
 
+		/* the padding shares the flash page, and so the ch/lun, of ppa */
+		nr_pgs += pad_flash_page(conv_ftl, nsecs_write_start);
+
 		swr.ppa = &ppa;
-		swr.xfer_size = wbuf->ppg_size;
+		swr.xfer_size = nr_pgs * spp->pgsz;
 		nsecs_completed = ssd_advance_nand(conv_ftl->ssd, &swr);
 		nsecs_result = max(nsecs_completed, nsecs_result);
 		ppg->complete_time = nsecs_completed;
 
 		schedule_internal_operation(req->sq_id, nsecs_completed, wbuf);
 
-		nvmev_vdev->device_write += wbuf->ppg_size;
+		nvmev_vdev->device_write += nr_pgs * spp->pgsz;
 	}
-	
+
+	conv_ftl->last_flush_time = nsecs_result;
 	return nsecs_result;
 }
 
@@ -1261,7 +2085,7 @@ static bool conv_write(struct nvmev_ns *ns, struct nvmev_request *req, struct nv
 
 			if (check_flush_buffer_allocate_fail(wbuf)) {
 				// NVMEV_INFO("Back RMW Start(%d) - Free buf %ld\n", i, list_count_nodes(&wbuf->free_ppgs));
-				conv_rmw(conv_ftl, req, nsecs_start);
+				conv_rmw(conv_ftl, req, nsecs_start, false);
 			}
 
 			spin_unlock(&wbuf->lock);
@@ -1290,13 +2114,40 @@ static bool conv_write(struct nvmev_ns *ns, struct nvmev_request *req, struct nv
 
 		if (check_flush_buffer(wbuf)) {
 			// NVMEV_INFO("Front RMW Start(%d)\n", i);
-			nsecs_latest = max(conv_rmw(conv_ftl, req, nsecs_xfer_completed), nsecs_latest);
+			nsecs_latest = max(conv_rmw(conv_ftl, req, nsecs_xfer_completed, false), nsecs_latest);
 		}
 
 		spin_unlock(&wbuf->lock);
 	}
 
-	if ((cmd->rw.control & NVME_RW_FUA) || (spp->write_early_completion == 0)) {
+	/*
+	 * Without a volatile write cache (or with FUA) the data must be on NAND
+	 * before completion, so program the partitions holding this command's
+	 * pages now even if their PPGs are not full.
+	 */
+	if ((cmd->rw.control & NVME_RW_FUA) || !nvmev_vdev->vwc_enabled) {
+		uint32_t parts = 0;
+
+		for (lpn = start_lpn; lpn <= end_lpn; lpn++)
+			parts |= 1U << GET_FTL_IDX(lpn);
+
+		for (int i = 0; i < nr_parts; i++) {
+			if (!(parts & (1U << i)))
+				continue;
+
+			conv_ftl = &conv_ftls[i];
+			wbuf = &conv_ftl->ssd->write_buffer;
+			while (!spin_trylock(&wbuf->lock))
+				;
+
+			nsecs_latest = max(conv_rmw(conv_ftl, req, nsecs_xfer_completed, true), nsecs_latest);
+
+			spin_unlock(&wbuf->lock);
+		}
+	}
+
+	if ((cmd->rw.control & NVME_RW_FUA) || (spp->write_early_completion == 0) ||
+	    !nvmev_vdev->vwc_enabled) {
 		/* Wait all flash operations */
 		ret->nsecs_target = nsecs_latest;
 	} else {
@@ -1311,15 +2162,135 @@ static bool conv_write(struct nvmev_ns *ns, struct nvmev_request *req, struct nv
 	return true;
 } 
 
+/*
+ * Unmap every lpn in [start_lpn, end_lpn] and point it at @new_ppa
+ * (UNMAPPED_PPA or UNCORRECTABLE_PPA). Only the mapping table is touched;
+ * stale pages are invalidated so that GC can reclaim them. Returns when the
+ * updated mapping entries are available.
+ */
+static uint64_t __conv_unmap_range(struct conv_ftl *conv_ftls, uint64_t start_lpn,
+				   uint64_t end_lpn, uint64_t new_ppa, uint64_t nsecs_start)
+{
+	struct conv_ftl *conv_ftl;
+	struct ppa ppa, mark = { .ppa = new_ppa };
+	uint64_t lpn, local_lpn;
+	uint64_t nsecs_xlat = nsecs_start;
+	uint32_t i;
+
+	for (lpn = start_lpn; lpn <= end_lpn; lpn++) {
+		conv_ftl = &conv_ftls[GET_FTL_IDX(lpn)];
+		local_lpn = LOCAL_LPN(lpn);
+
+		nsecs_xlat = max(nsecs_xlat, map_access(conv_ftl, local_lpn, true, nsecs_start));
+		ppa = get_maptbl_ent(conv_ftl, local_lpn);
+		if (mapped_ppa(&ppa)) {
+			mark_page_invalid(conv_ftl, &ppa);
+			set_rmap_ent(conv_ftl, INVALID_LPN, &ppa);
+		}
+		set_maptbl_ent(conv_ftl, local_lpn, &mark);
+	}
+
+	/* a pending buffered copy must not resurrect the mapping on flush */
+	for (i = 0; i < ssd_profile.nr_parts; i++)
+		buffer_discard(&conv_ftls[i].ssd->write_buffer, start_lpn, end_lpn);
+
+	return nsecs_xlat;
+}
+
+/*
+ * Write Zeroes is a mapping-only operation. Logical pages fully covered by
+ * the range are deallocated; partially covered ones keep their mapping and
+ * only get their backing memory cleared by the io worker.
+ */
+static bool conv_write_zeroes(struct nvmev_ns *ns, struct nvmev_request *req,
+			      struct nvmev_result *ret)
+{
+	struct conv_ftl *conv_ftls = (struct conv_ftl *)ns->ftls;
+	struct ssdparams *spp = &conv_ftls[0].ssd->sp;
+	struct nvme_command *cmd = req->cmd;
+	uint64_t lba = cmd->rw.slba;
+	uint64_t nr_lba = (cmd->rw.length + 1);
+	uint64_t start_lpn = DIV_ROUND_UP(lba, spp->secs_per_pg);
+	uint64_t end_lpn = (lba + nr_lba) / spp->secs_per_pg;
+	uint64_t nsecs_xlat = req->nsecs_start;
+
+	if (((lba + nr_lba - 1) / spp->secs_per_pg / ns->nr_parts) >= spp->tt_pgs) {
+		NVMEV_ERROR("%s: lpn passed FTL range (slba=%lld > tt_pgs=%ld)\n", __func__, lba,
+			    spp->tt_pgs);
+		return false;
+	}
+
+	if (end_lpn > start_lpn)
+		nsecs_xlat = __conv_unmap_range(conv_ftls, start_lpn, end_lpn - 1, UNMAPPED_PPA,
+						req->nsecs_start);
+
+	/* no data moves over PCIe or NAND channels, only firmware and mapping overhead */
+	ret->nsecs_target = max(req->nsecs_start + spp->fw_wbuf_lat0, nsecs_xlat);
+	ret->status = NVME_SC_SUCCESS;
+
+	return true;
+}
+
+/*
+ * Write Uncorrectable marks the logical pages of the range so that reads fail
+ * until the page is written again. The mark is kept per logical page, so a
+ * range that covers only part of one is rejected rather than failing reads of
+ * sectors the host did not name.
+ */
+static bool conv_write_uncor(struct nvmev_ns *ns, struct nvmev_request *req,
+			     struct nvmev_result *ret)
+{
+	struct conv_ftl *conv_ftls = (struct conv_ftl *)ns->ftls;
+	struct ssdparams *spp = &conv_ftls[0].ssd->sp;
+	struct nvme_command *cmd = req->cmd;
+	uint64_t lba = cmd->rw.slba;
+	uint64_t nr_lba = (cmd->rw.length + 1);
+	uint64_t start_lpn = lba / spp->secs_per_pg;
+	uint64_t end_lpn = (lba + nr_lba - 1) / spp->secs_per_pg;
+
+	if ((end_lpn / ns->nr_parts) >= spp->tt_pgs) {
+		NVMEV_ERROR("%s: lpn passed FTL range (start_lpn=%lld > tt_pgs=%ld)\n", __func__,
+			    start_lpn, spp->tt_pgs);
+		return false;
+	}
+
+	ret->nsecs_target = req->nsecs_start + spp->fw_wbuf_lat0;
+
+	if ((lba % spp->secs_per_pg) || ((lba + nr_lba) % spp->secs_per_pg)) {
+		ret->status = NVME_SC_INVALID_FIELD;
+		return true;
+	}
+
+	ret->nsecs_target = max(ret->nsecs_target,
+				__conv_unmap_range(conv_ftls, start_lpn, end_lpn, UNCORRECTABLE_PPA,
+						   req->nsecs_start));
+	ret->status = NVME_SC_SUCCESS;
+
+	return true;
+}
+
+/*
+ * Flush programs every buffered PPG, full or not, and completes once they
+ * and everything already in flight are on NAND.
+ */
 static void conv_flush(struct nvmev_ns *ns, struct nvmev_request *req, struct nvmev_result *ret)
 {
 	uint64_t start, latest;
 	uint32_t i;
 	struct conv_ftl *conv_ftls = (struct conv_ftl *)ns->ftls;
+	struct buffer *wbuf;
 
-	start = local_clock();
+	start = req->nsecs_start;
 	latest = start;
 	for (i = 0; i < ns->nr_parts; i++) {
+		wbuf = &conv_ftls[i].ssd->write_buffer;
+		while (!spin_trylock(&wbuf->lock))
+			;
+
+		latest = max(latest, conv_rmw(&conv_ftls[i], req, start, true));
+
+		spin_unlock(&wbuf->lock);
+
 		latest = max(latest, ssd_next_idle_time(conv_ftls[i].ssd));
 	}
 
@@ -1348,6 +2319,14 @@ bool conv_proc_nvme_io_cmd(struct nvmev_ns *ns, struct nvmev_request *req, struc
 	case nvme_cmd_flush:
 		conv_flush(ns, req, ret);
 		break;
+	case nvme_cmd_write_zeroes:
+		if (!conv_write_zeroes(ns, req, ret))
+			return false;
+		break;
+	case nvme_cmd_write_uncor:
+		if (!conv_write_uncor(ns, req, ret))
+			return false;
+		break;
 	default:
 		NVMEV_ERROR("%s: command not implemented: %s (0x%x)\n", __func__,
 				nvme_opcode_string(cmd->common.opcode), cmd->common.opcode);
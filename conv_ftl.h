@@ -12,6 +12,18 @@ struct convparams {
 	uint32_t gc_thres_lines;
 	uint32_t gc_thres_lines_high;
 	bool enable_gc_delay;
+	bool enable_copyback; /* on-die copyback when GC stays within a plane */
+
+	uint32_t rc_flashpgs; /* read cache size in flash pages, 0 disables it */
+	uint32_t ra_flashpgs; /* flash pages to read ahead */
+	uint32_t ra_trigger; /* sequential commands before reading ahead */
+
+	uint32_t slc_pcent; /* share of lines used as SLC cache, 0 disables it */
+	uint64_t slc_fold_idle; /* idle time before folding the SLC cache */
+
+	uint32_t l2p_cache_segs; /* on-device mapping segments, 0 keeps the whole map */
+	uint32_t hmb_lat; /* PCIe round trip of an HMB fetch */
+	uint32_t cmt_tpgs; /* cached translation pages without an HMB, 0 keeps the whole map */
 
 	double op_area_pcent;
 	int pba_pcent; /* (physical space / logical space) * 100*/
@@ -21,6 +33,7 @@ struct line {
 	int id; /* line id, the same as corresponding block id */
 	int ipc; /* invalid page count in this line */
 	int vpc; /* valid page count in this line */
+	bool slc; /* written in SLC mode */
 	struct list_head entry;
 	/* position in the priority queue for victim lines */
 	size_t pos;
@@ -43,11 +56,15 @@ struct line_mgmt {
 	struct list_head free_line_list;
 	pqueue_t *victim_line_pq;
 	struct list_head full_line_list;
+	/* closed SLC lines waiting to be folded, oldest first */
+	struct list_head slc_line_list;
 
 	uint32_t tt_lines;
 	uint32_t free_line_cnt;
 	uint32_t victim_line_cnt;
 	uint32_t full_line_cnt;
+	uint32_t slc_line_cnt; /* open and closed SLC lines */
+	uint32_t slc_max_lines;
 };
 
 struct write_flow_control {
@@ -55,6 +72,81 @@ struct write_flow_control {
 	uint32_t credits_to_refill;
 };
 
+struct read_cache_entry {
+	struct ppa ppa; /* first page of the cached flash page */
+	uint64_t ready_time; /* when the data is in DRAM */
+	bool ref; /* CLOCK reference bit */
+	bool prefetched; /* filled by read-ahead and not hit yet */
+	struct hlist_node hnode; /* in the bucket of its flash page */
+};
+
+/* DRAM read cache over flash pages, CLOCK replacement */
+struct read_cache {
+	struct read_cache_entry *entries;
+	uint32_t nr_entries;
+	uint32_t hand;
+	struct hlist_head *buckets; /* entries hashed by flash page */
+	uint32_t hash_bits;
+
+	/* sequential stream detector */
+	uint64_t next_lpn; /* local lpn following the last read */
+	uint32_t seq_cnt;
+};
+
+/* a NAND read of one flash page planned by conv_read() */
+struct conv_read_op {
+	uint32_t ftl_idx;
+	uint32_t xfer_size;
+	uint32_t round; /* # of earlier ops on the same LUN */
+	struct ppa ppa;
+};
+
+/* preallocated planning space of conv_read(), which only runs on the dispatcher */
+struct conv_read_ops {
+	struct conv_read_op *ops; /* one batch, of the first partition only */
+	uint32_t *order; /* ops of the batch sorted by round */
+	uint32_t *round_cnt; /* ops per round, then first slot of each round */
+	uint32_t max_ops;
+	uint32_t *lun_ops; /* ops planned so far on every LUN of this partition */
+};
+
+/* the device stores 4-byte mapping entries and moves them in 64-byte segments */
+#define L2P_ENTRY_SIZE (4)
+#define L2P_SEG_ENTRIES (16)
+#define L2P_SEG_SIZE (L2P_ENTRY_SIZE * L2P_SEG_ENTRIES)
+#define L2P_NO_SLOT (UINT_MAX)
+
+struct l2p_cache_entry {
+	uint64_t seg; /* mapping segment, INVALID_LPN if the slot is free */
+	bool ref; /* CLOCK reference bit */
+	bool dirty; /* updated since it was fetched */
+};
+
+/* on-device cache of the mapping table kept in the HMB, CLOCK replacement */
+struct l2p_cache {
+	struct l2p_cache_entry *entries;
+	uint32_t nr_entries;
+	uint32_t hand;
+	uint32_t *slots; /* slot of every segment, L2P_NO_SLOT if not cached */
+};
+
+struct cmt_entry {
+	uint32_t tpn; /* translation page */
+	bool dirty; /* newer than its copy on NAND */
+	struct list_head lru;
+};
+
+/* DFTL cached mapping table over translation pages on NAND, LRU replacement */
+struct cmt {
+	struct cmt_entry *entries;
+	uint32_t nr_entries;
+	uint32_t nr_used;
+	struct list_head lru; /* most recently used first */
+	uint32_t *slots; /* slot of every translation page, L2P_NO_SLOT if not cached */
+	struct ppa *gtd; /* global translation directory: where each translation page is */
+	uint32_t ents_per_tpg; /* mapping entries in a translation page */
+};
+
 struct conv_ftl {
 	struct ssd *ssd;
 
@@ -65,10 +157,21 @@ struct conv_ftl {
 	struct write_pointer gc_wp;
 	struct line_mgmt lm;
 	struct write_flow_control wfc;
+	struct read_cache rc;
+	struct l2p_cache lc;
+	struct cmt cmt;
+	struct conv_read_ops ro;
+
+	/* GC data staged for the current gc_wp oneshot page */
+	uint64_t gc_ready_time;
+	uint32_t gc_xfer_pgs;
+
+	uint64_t last_flush_time; /* completion of the last buffer flush */
 };
 
-void conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
-			 uint32_t cpu_nr_dispatcher);
+uint64_t conv_fit_namespace_size(uint64_t size);
+int conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
+			uint32_t cpu_nr_dispatcher);
 
 void conv_remove_namespace(struct nvmev_ns *ns);
 
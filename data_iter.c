@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/highmem.h>
+
+#include "nvmev.h"
+#include "data_iter.h"
+
+/*
+ * Copy one physically contiguous host extent. Lowmem pages are in the direct
+ * map, so the whole extent is copied at once; highmem pages still have to be
+ * mapped one at a time. Large writes bypass the cache on the storage side.
+ * Extents in the CMB are already device memory and need no translation.
+ */
+void nvmev_copy_extent(bool to_dev, void *storage, u64 paddr, size_t len, bool nt)
+{
+	unsigned long pfn = paddr >> PAGE_SHIFT;
+	unsigned long last_pfn = (paddr + len - 1) >> PAGE_SHIFT;
+	void *cmb = nvmev_cmb_vaddr(paddr);
+
+	if (cmb || (!PageHighMem(pfn_to_page(pfn)) && !PageHighMem(pfn_to_page(last_pfn)))) {
+		void *vaddr = cmb ? cmb : pfn_to_kaddr(pfn) + offset_in_page(paddr);
+
+		if (!to_dev)
+			memcpy(vaddr, storage, len);
+		else if (nt)
+			memcpy_flushcache(storage, vaddr, len);
+		else
+			memcpy(storage, vaddr, len);
+		return;
+	}
+
+	while (len) {
+		size_t mem_offs = offset_in_page(paddr);
+		size_t io_size = min_t(size_t, len, PAGE_SIZE - mem_offs);
+		void *vaddr = kmap_atomic_pfn(paddr >> PAGE_SHIFT);
+
+		if (to_dev)
+			memcpy(storage, vaddr + mem_offs, io_size);
+		else
+			memcpy(vaddr + mem_offs, storage, io_size);
+
+		kunmap_atomic(vaddr);
+
+		storage += io_size;
+		paddr += io_size;
+		len -= io_size;
+	}
+}
+
+/*
+ * Walk the PRPs covering [pos, pos + len) and merge physically contiguous
+ * pages into one extent. The PRP entry covering pos is found directly, so the
+ * range can be any chunk of the data, and the PRP list page is mapped once.
+ */
+static void __for_each_prp_extent(struct nvmev_dptr *dptr, size_t pos, size_t len,
+				  data_extent_fn fn, void *arg)
+{
+	u64 prp1 = dptr->dptr1, prp2 = dptr->dptr2;
+	size_t first = min_t(size_t, dptr->length, PAGE_SIZE - (prp1 & PAGE_OFFSET_MASK));
+	u64 *paddr_list = NULL;
+	bool list_mapped = false;
+	u64 ext_paddr = 0;
+	size_t ext_offs = 0, ext_len = 0;
+
+	if (dptr->length - first > PAGE_SIZE) {
+		paddr_list = nvmev_cmb_vaddr(prp2);
+		if (!paddr_list) {
+			paddr_list = kmap_atomic_pfn(PRP_PFN(prp2)) + (prp2 & PAGE_OFFSET_MASK);
+			list_mapped = true;
+		}
+	}
+
+	while (len) {
+		u64 paddr;
+		size_t io_size;
+
+		if (pos < first) {
+			paddr = prp1 + pos;
+			io_size = first - pos;
+		} else {
+			size_t idx = (pos - first) >> PAGE_SHIFT;
+			size_t mem_offs = (pos - first) & PAGE_OFFSET_MASK;
+
+			paddr = (paddr_list ? paddr_list[idx] : prp2) + mem_offs;
+			io_size = PAGE_SIZE - mem_offs;
+		}
+		io_size = min_t(size_t, io_size, len);
+
+		if (ext_len && paddr == ext_paddr + ext_len) {
+			ext_len += io_size;
+		} else {
+			if (ext_len)
+				fn(ext_offs, ext_paddr, ext_len, arg);
+			ext_paddr = paddr;
+			ext_offs = pos;
+			ext_len = io_size;
+		}
+
+		pos += io_size;
+		len -= io_size;
+	}
+
+	if (ext_len)
+		fn(ext_offs, ext_paddr, ext_len, arg);
+
+	if (list_mapped)
+		kunmap_atomic(paddr_list);
+}
+
+/* SGL descriptors may live anywhere in host memory */
+static void __read_sgl_desc(u64 paddr, struct nvme_sgl_desc *desc)
+{
+	void *vaddr = nvmev_cmb_vaddr(paddr);
+
+	if (vaddr) {
+		memcpy(desc, vaddr, sizeof(*desc));
+		return;
+	}
+
+	vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
+
+	memcpy(desc, vaddr + (paddr & PAGE_OFFSET_MASK), sizeof(*desc));
+	kunmap_atomic(vaddr);
+}
+
+/*
+ * Every SGL data block is one extent; bit buckets take their share of the
+ * data without being copied. Returns the SGL status of a malformed list.
+ */
+static u16 __for_each_sgl_extent(struct nvmev_dptr *dptr, size_t pos, size_t len,
+				 data_extent_fn fn, void *arg)
+{
+	struct nvme_sgl_desc desc;
+	u64 seg = 0;
+	unsigned int nr_descs = 0; /* left in the current segment */
+	bool last_seg = false;
+	size_t offs = 0; /* position of desc in the data */
+
+	memcpy(&desc, &dptr->dptr1, sizeof(dptr->dptr1));
+	memcpy((void *)&desc + sizeof(dptr->dptr1), &dptr->dptr2, sizeof(dptr->dptr2));
+
+	while (len) {
+		switch (desc.type >> 4) {
+		case NVME_SGL_FMT_DATA_DESC:
+		case NVME_SGL_FMT_BIT_BUCKET_DESC:
+			if (offs + desc.length > pos) {
+				size_t skip = pos - offs;
+				size_t io_size = min_t(size_t, desc.length - skip, len);
+
+				if ((desc.type >> 4) == NVME_SGL_FMT_DATA_DESC)
+					fn(pos, desc.addr + skip, io_size, arg);
+
+				pos += io_size;
+				len -= io_size;
+			}
+			offs += desc.length;
+			break;
+		case NVME_SGL_FMT_SEG_DESC:
+		case NVME_SGL_FMT_LAST_SEG_DESC:
+			/* only the last entry of a segment may chain, never in the last one */
+			if (nr_descs || last_seg)
+				return NVME_SC_SGL_INVALID_LAST;
+			seg = desc.addr;
+			nr_descs = desc.length / sizeof(desc);
+			last_seg = ((desc.type >> 4) == NVME_SGL_FMT_LAST_SEG_DESC);
+			break;
+		default:
+			NVMEV_DEBUG("Unsupported SGL descriptor type %#x\n", desc.type);
+			return NVME_SC_SGL_INVALID_TYPE;
+		}
+
+		if (!len)
+			break;
+
+		if (!nr_descs) {
+			NVMEV_DEBUG("SGL is shorter than the data (%zu bytes left)\n", len);
+			return NVME_SC_SGL_INVALID_DATA;
+		}
+
+		__read_sgl_desc(seg, &desc);
+		seg += sizeof(desc);
+		nr_descs--;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+/*
+ * Call @fn for every physically contiguous host extent of [pos, pos + len).
+ * PRPs cannot be malformed in a way the walk notices, SGLs can.
+ */
+u16 dptr_for_each_extent(struct nvmev_dptr *dptr, size_t pos, size_t len, data_extent_fn fn,
+			 void *arg)
+{
+	if (dptr->flags & NVME_CMD_SGL_ALL)
+		return __for_each_sgl_extent(dptr, pos, len, fn, arg);
+
+	__for_each_prp_extent(dptr, pos, len, fn, arg);
+	return NVME_SC_SUCCESS;
+}
+
+static void __dptr_check_fn(size_t offs, u64 paddr, size_t len, void *arg)
+{
+}
+
+/* walk the whole data pointer without moving data, to fail a command up front */
+u16 dptr_check(struct nvmev_dptr *dptr)
+{
+	return dptr_for_each_extent(dptr, 0, dptr->length, __dptr_check_fn, NULL);
+}
+
+struct dptr_copy_ctx {
+	void *buf;
+	bool to_host;
+};
+
+static void __dptr_copy_fn(size_t offs, u64 paddr, size_t len, void *arg)
+{
+	struct dptr_copy_ctx *ctx = arg;
+
+	nvmev_copy_extent(!ctx->to_host, ctx->buf + offs, paddr, len, false);
+}
+
+/* copy the first @len bytes of the data between @buf and the host */
+u16 dptr_copy(struct nvmev_dptr *dptr, void *buf, size_t len, bool to_host)
+{
+	struct dptr_copy_ctx ctx = {
+		.buf = buf,
+		.to_host = to_host,
+	};
+
+	return dptr_for_each_extent(dptr, 0, len, __dptr_copy_fn, &ctx);
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef _NVMEVIRT_DATA_ITER_H
+#define _NVMEVIRT_DATA_ITER_H
+
+#include <linux/types.h>
+
+/* data pointer of a command: PRP1/PRP2, or one SGL descriptor when PSDT says so */
+struct nvmev_dptr {
+	u8 flags; /* command flags, for PSDT */
+	u64 dptr1;
+	u64 dptr2;
+	size_t length; /* bytes described */
+};
+
+/* @offs is the position of the extent in the data of the command */
+typedef void (*data_extent_fn)(size_t offs, u64 paddr, size_t len, void *arg);
+
+u16 dptr_for_each_extent(struct nvmev_dptr *dptr, size_t pos, size_t len, data_extent_fn fn,
+			 void *arg);
+u16 dptr_check(struct nvmev_dptr *dptr);
+u16 dptr_copy(struct nvmev_dptr *dptr, void *buf, size_t len, bool to_host);
+
+void nvmev_copy_extent(bool to_dev, void *storage, u64 paddr, size_t len, bool nt);
+
+#endif /* _NVMEVIRT_DATA_ITER_H */
@@ -75,12 +75,6 @@ static struct ioat_dma_info {
 	.lock = __MUTEX_INITIALIZER(test_info.lock),
 };
 
-struct ioat_dma_thread {
-	struct ioat_dma_info *info;
-	struct dma_chan *chan;
-	enum dma_transaction_type type;
-};
-
 struct ioat_dma_chan {
 	struct list_head node;
 	struct dma_chan *chan;
@@ -92,7 +86,10 @@ static char test_channel[CHANNEL_NAME_LEN];
 /* Maximum amount of mismatched bytes in buffer to print */
 #define MAX_ERROR_COUNT 32
 
-static struct ioat_dma_thread dma_thread;
+/* memcpy capable channels, io workers pick one by their id */
+#define IOAT_DMA_MAX_CHANNELS 16
+static struct dma_chan *dma_chans[IOAT_DMA_MAX_CHANNELS];
+static unsigned int nr_dma_chans;
 
 static bool ioat_dma_match_channel(struct ioat_dma_params *params, struct dma_chan *chan)
 {
@@ -115,68 +112,45 @@ static void result(const char *err, unsigned int n, dma_addr_t src_addr, dma_add
 		 current->comm, n, err, src_addr, dst_addr, len, data);
 }
 
-int ioat_dma_submit(dma_addr_t src_addr, dma_addr_t dst_addr, unsigned int size)
+struct dma_chan *ioat_dma_get_chan(unsigned int id)
 {
-	struct ioat_dma_thread *thread = &dma_thread;
-	struct ioat_dma_info *info;
-	struct dma_chan *chan;
-	struct dma_device *dev;
-	dma_cookie_t cookie;
-	enum dma_status status;
-	enum dma_ctrl_flags flags = DMA_CTRL_ACK; /* Always use polled mode */
-	int ret;
-	int i;
-	struct dma_async_tx_descriptor *tx = NULL;
-
-	set_freezable();
+	if (nr_dma_chans == 0)
+		return NULL;
 
-	pr_debug("START: 0x%llx -> 0x%llx, len: %d\n", src_addr, dst_addr, size);
+	return dma_chans[id % nr_dma_chans];
+}
 
-	ret = -ENOMEM;
+/*
+ * Queue a memcpy descriptor on @chan without waiting for it. @callback runs
+ * from the channel's completion handling once the copy is done. The caller
+ * kicks the channel with dma_async_issue_pending() after queueing a batch.
+ */
+int ioat_dma_submit_async(struct dma_chan *chan, dma_addr_t src_addr, dma_addr_t dst_addr,
+			  unsigned int size, dma_async_tx_callback callback, void *param)
+{
+	struct dma_device *dev = chan->device;
+	enum dma_ctrl_flags flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT;
+	struct dma_async_tx_descriptor *tx;
+	dma_cookie_t cookie;
 
-	smp_rmb();
-	info = thread->info;
-	chan = thread->chan;
-	dev = chan->device;
+	pr_debug("START: 0x%llx -> 0x%llx, len: %d\n", src_addr, dst_addr, size);
 
-	/* thread->type is always DMA_MEMCPY */
 	tx = dev->device_prep_dma_memcpy(chan, dst_addr, src_addr, size, flags);
-
 	if (!tx) {
-		result("prep error", 1, src_addr, dst_addr, size, ret);
-		msleep(100);
-		goto out;
+		result("prep error", 1, src_addr, dst_addr, size, -ENOMEM);
+		return -ENOMEM;
 	}
 
-	cookie = tx->tx_submit(tx);
+	tx->callback = callback;
+	tx->callback_param = param;
 
+	cookie = dmaengine_submit(tx);
 	if (dma_submit_error(cookie)) {
-		result("submit error", 1, src_addr, dst_addr, size, ret);
-		msleep(100);
-		goto out;
-	}
-
-	/* Always use polled mode */
-	status = dma_sync_wait(chan, cookie);
-	dmaengine_terminate_sync(chan);
-
-	if (status != DMA_COMPLETE &&
-	    !(dma_has_cap(DMA_COMPLETION_NO_ORDER, dev->cap_mask) && status == DMA_OUT_OF_ORDER)) {
-		result(status == DMA_ERROR ? "completion error status" : "completion busy status",
-		       1, src_addr, dst_addr, size, ret);
-		goto out;
+		result("submit error", 1, src_addr, dst_addr, size, cookie);
+		return -EIO;
 	}
 
-	ret = 0;
-
-out:
-	pr_debug("DONE: 0x%llx -> 0x%llx, len: %d\n", src_addr, dst_addr, size);
-
-	/* terminate all transfers on specified channels */
-	if (ret)
-		dmaengine_terminate_sync(chan);
-
-	return ret;
+	return 0;
 }
 
 static int ioat_dma_add_channel(struct ioat_dma_info *info, struct dma_chan *chan)
@@ -199,11 +173,10 @@ static int ioat_dma_add_channel(struct ioat_dma_info *info, struct dma_chan *cha
 		pr_warn("DMA_COMPLETION_NO_ORDER, polled disabled\n");
 	}
 
-	if (dma_has_cap(DMA_MEMCPY, dma_dev->cap_mask)) {
+	if (dma_has_cap(DMA_MEMCPY, dma_dev->cap_mask) && nr_dma_chans < IOAT_DMA_MAX_CHANNELS) {
 		pr_info("ioat_dma_add_threads\n");
-		dma_thread.info = info;
-		dma_thread.chan = dtc->chan;
-		dma_thread.type = DMA_MEMCPY;
+		dma_chans[nr_dma_chans++] = dtc->chan;
+		thread_count++;
 	}
 
 	pr_info("Added %u threads using %s\n", thread_count, dma_chan_name(chan));
@@ -339,4 +312,74 @@ void ioat_dma_cleanup(void)
 	}
 
 	info->nr_channels = 0;
+	nr_dma_chans = 0;
+}
+
+static int ioat_dma_init(unsigned int nr_chans, unsigned int *cpus)
+{
+	unsigned int i;
+
+	/* one channel per io worker where available, workers share them otherwise */
+	for (i = 0; i < nr_chans; i++) {
+		char chan_name[CHANNEL_NAME_LEN];
+
+		snprintf(chan_name, sizeof(chan_name), "dma7chan%u", i);
+		if (ioat_dma_chan_set(chan_name) != 0)
+			break;
+	}
+
+	return (i == 0) ? -ENODEV : 0;
+}
+
+static void *ioat_dma_ops_get_chan(unsigned int id)
+{
+	return ioat_dma_get_chan(id);
+}
+
+static int ioat_dma_ops_submit(void *chan, struct nvmev_dma_desc *desc)
+{
+	dma_addr_t src = desc->to_dev ? desc->host : desc->dev;
+	dma_addr_t dst = desc->to_dev ? desc->dev : desc->host;
+
+	return ioat_dma_submit_async(chan, src, dst, desc->len, desc->callback, desc->param);
+}
+
+static void ioat_dma_ops_issue_pending(void *chan)
+{
+	dma_async_issue_pending(chan);
+}
+
+const struct nvmev_dma_ops ioat_dma_ops = {
+	.name = "ioat",
+	.init = ioat_dma_init,
+	.cleanup = ioat_dma_cleanup,
+	.get_chan = ioat_dma_ops_get_chan,
+	.submit = ioat_dma_ops_submit,
+	.issue_pending = ioat_dma_ops_issue_pending,
+};
+
+const struct nvmev_dma_ops *nvmev_dma;
+
+int nvmev_dma_init(const char *backend, unsigned int nr_chans, unsigned int *cpus)
+{
+	const struct nvmev_dma_ops *ops = &ioat_dma_ops;
+	int ret;
+
+	if (strcmp(backend, memcpy_dma_ops.name) == 0)
+		ops = &memcpy_dma_ops;
+
+	ret = ops->init(nr_chans, cpus);
+	if (ret == 0) {
+		nvmev_dma = ops;
+		pr_info("Using %s DMA backend\n", ops->name);
+	}
+
+	return ret;
+}
+
+void nvmev_dma_cleanup(void)
+{
+	if (nvmev_dma)
+		nvmev_dma->cleanup();
+	nvmev_dma = NULL;
 }
@@ -3,9 +3,44 @@
 #ifndef _LIB_DMA_H
 #define _LIB_DMA_H
 
+#include <linux/dmaengine.h>
+
+/* one physically contiguous copy between a host buffer and the storage */
+struct nvmev_dma_desc {
+	dma_addr_t host; /* host buffer, physical */
+	dma_addr_t dev; /* storage, physical */
+	void *dev_vaddr; /* storage, mapped */
+	unsigned int len;
+	bool to_dev;
+	dma_async_tx_callback callback; /* called once the copy is done */
+	void *param;
+};
+
+/*
+ * A DMA backend queues descriptors on a channel without waiting for them and
+ * reports each completion through the descriptor's callback.
+ */
+struct nvmev_dma_ops {
+	const char *name;
+	int (*init)(unsigned int nr_chans, unsigned int *cpus);
+	void (*cleanup)(void);
+	void *(*get_chan)(unsigned int id);
+	int (*submit)(void *chan, struct nvmev_dma_desc *desc);
+	void (*issue_pending)(void *chan);
+};
+
+extern const struct nvmev_dma_ops ioat_dma_ops;
+extern const struct nvmev_dma_ops memcpy_dma_ops;
+extern const struct nvmev_dma_ops *nvmev_dma;
+
+int nvmev_dma_init(const char *backend, unsigned int nr_chans, unsigned int *cpus);
+void nvmev_dma_cleanup(void);
+
 // DMA Init, Final Function
 int ioat_dma_chan_set(const char *val);
-int ioat_dma_submit(dma_addr_t src_addr, dma_addr_t dst_addr, unsigned int size);
+struct dma_chan *ioat_dma_get_chan(unsigned int id);
+int ioat_dma_submit_async(struct dma_chan *chan, dma_addr_t src_addr, dma_addr_t dst_addr,
+			  unsigned int size, dma_async_tx_callback callback, void *param);
 void ioat_dma_cleanup(void);
 
 #endif /* _LIB_DMA_H */
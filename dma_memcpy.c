@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/kthread.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/wait.h>
+
+#include "dma.h"
+#include "data_iter.h"
+
+/*
+ * Software DMA backend: every channel is a copy thread placed on the NUMA
+ * node of the io worker using it. Copies are done in chunks so that the
+ * thread does not hog its CPU, and writes into the storage are non-temporal.
+ */
+#define MEMCPY_DMA_RING_SIZE (256)
+#define MEMCPY_DMA_CHUNK_SIZE (SZ_64K)
+
+struct memcpy_dma_chan {
+	spinlock_t lock;
+	struct nvmev_dma_desc ring[MEMCPY_DMA_RING_SIZE];
+	unsigned int head; /* next descriptor to copy */
+	unsigned int tail; /* next free slot */
+	wait_queue_head_t wq;
+	struct task_struct *task;
+};
+
+static struct memcpy_dma_chan *memcpy_chans;
+static unsigned int nr_memcpy_chans;
+
+static int memcpy_dma_thread(void *data)
+{
+	struct memcpy_dma_chan *c = data;
+
+	while (!kthread_should_stop()) {
+		struct nvmev_dma_desc desc;
+		unsigned int done;
+
+		wait_event_interruptible(c->wq, READ_ONCE(c->head) != READ_ONCE(c->tail) ||
+							kthread_should_stop());
+
+		spin_lock(&c->lock);
+		if (c->head == c->tail) {
+			spin_unlock(&c->lock);
+			continue;
+		}
+		desc = c->ring[c->head % MEMCPY_DMA_RING_SIZE];
+		c->head++;
+		spin_unlock(&c->lock);
+
+		for (done = 0; done < desc.len; done += MEMCPY_DMA_CHUNK_SIZE) {
+			unsigned int len = min_t(unsigned int, desc.len - done, MEMCPY_DMA_CHUNK_SIZE);
+
+			nvmev_copy_extent(desc.to_dev, desc.dev_vaddr + done, desc.host + done, len,
+					  true);
+			cond_resched();
+		}
+
+		desc.callback(desc.param);
+	}
+
+	return 0;
+}
+
+static void memcpy_dma_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_memcpy_chans; i++) {
+		if (!IS_ERR_OR_NULL(memcpy_chans[i].task))
+			kthread_stop(memcpy_chans[i].task);
+	}
+
+	kfree(memcpy_chans);
+	memcpy_chans = NULL;
+	nr_memcpy_chans = 0;
+}
+
+static int memcpy_dma_init(unsigned int nr_chans, unsigned int *cpus)
+{
+	unsigned int i;
+
+	memcpy_chans = kcalloc(nr_chans, sizeof(struct memcpy_dma_chan), GFP_KERNEL);
+	if (!memcpy_chans)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_chans; i++) {
+		struct memcpy_dma_chan *c = &memcpy_chans[i];
+		int node = cpu_to_node(cpus[i]);
+
+		spin_lock_init(&c->lock);
+		init_waitqueue_head(&c->wq);
+
+		c->task = kthread_create_on_node(memcpy_dma_thread, c, node, "nvmev_dma_%u", i);
+		if (IS_ERR(c->task)) {
+			nr_memcpy_chans = i;
+			memcpy_dma_cleanup();
+			return -ENOMEM;
+		}
+		set_cpus_allowed_ptr(c->task, cpumask_of_node(node));
+		wake_up_process(c->task);
+	}
+	nr_memcpy_chans = nr_chans;
+
+	return 0;
+}
+
+static void *memcpy_dma_get_chan(unsigned int id)
+{
+	return &memcpy_chans[id % nr_memcpy_chans];
+}
+
+static int memcpy_dma_submit(void *chan, struct nvmev_dma_desc *desc)
+{
+	struct memcpy_dma_chan *c = chan;
+	int ret = 0;
+
+	spin_lock(&c->lock);
+	if (c->tail - c->head == MEMCPY_DMA_RING_SIZE)
+		ret = -EBUSY;
+	else
+		c->ring[c->tail++ % MEMCPY_DMA_RING_SIZE] = *desc;
+	spin_unlock(&c->lock);
+
+	return ret;
+}
+
+static void memcpy_dma_issue_pending(void *chan)
+{
+	struct memcpy_dma_chan *c = chan;
+
+	wake_up(&c->wq);
+}
+
+const struct nvmev_dma_ops memcpy_dma_ops = {
+	.name = "memcpy",
+	.init = memcpy_dma_init,
+	.cleanup = memcpy_dma_cleanup,
+	.get_chan = memcpy_dma_get_chan,
+	.submit = memcpy_dma_submit,
+	.issue_pending = memcpy_dma_issue_pending,
+};
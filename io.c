@@ -8,6 +8,7 @@
 
 #include "nvmev.h"
 #include "dma.h"
+#include "data_iter.h"
 
 #if (SUPPORTED_SSD_TYPE(CONV) || SUPPORTED_SSD_TYPE(ZNS))
 #include "ssd.h"
@@ -17,10 +18,15 @@ struct buffer;
 
 #undef PERF_DEBUG
 
+/* commands at least this large are written to the storage with non-temporal stores */
+#define IO_NT_COPY_SIZE (KB(64))
+/* commands larger than a chunk are copied by several io workers */
+#define IO_COPY_CHUNK_SIZE (KB(64))
+
 #define sq_entry(entry_id) sq->sq[SQ_ENTRY_TO_PAGE_NUM(entry_id)][SQ_ENTRY_TO_PAGE_OFFSET(entry_id)]
 #define cq_entry(entry_id) cq->cq[CQ_ENTRY_TO_PAGE_NUM(entry_id)][CQ_ENTRY_TO_PAGE_OFFSET(entry_id)]
 
-extern bool io_using_dma;
+extern int io_using_dma;
 
 static inline unsigned int __get_io_worker(int sqid)
 {
@@ -31,11 +37,6 @@ static inline unsigned int __get_io_worker(int sqid)
 #endif
 }
 
-static inline unsigned long long __get_wallclock(void)
-{
-	return cpu_clock(nvmev_vdev->config.cpu_nr_dispatcher);
-}
-
 static inline size_t __cmd_io_offset(struct nvme_rw_command *cmd)
 {
 	return (cmd->slba) << LBA_BITS;
@@ -46,167 +47,252 @@ static inline size_t __cmd_io_size(struct nvme_rw_command *cmd)
 	return (cmd->length + 1) << LBA_BITS;
 }
 
-static unsigned int __do_perform_io(int sqid, int sq_entry)
+/*
+ * Write Zeroes never touches host memory. The range is cleared with
+ * non-temporal stores so that zeroing a large device does not flush the LLC.
+ */
+static unsigned int __do_perform_io_write_zeroes(int sqid, int sq_entry)
 {
 	struct nvmev_submission_queue *sq = nvmev_vdev->sqes[sqid];
 	struct nvme_rw_command *cmd = &sq_entry(sq_entry).rw;
-	size_t offset;
-	size_t length, remaining;
-	int prp_offs = 0;
-	int prp2_offs = 0;
-	u64 paddr;
-	u64 *paddr_list = NULL;
 	size_t nsid = cmd->nsid - 1; // 0-based
-
-	offset = __cmd_io_offset(cmd);
-	length = __cmd_io_size(cmd);
-	remaining = length;
+	void *zero_page = page_address(ZERO_PAGE(0));
+	void *dst = nvmev_vdev->ns[nsid].mapped + __cmd_io_offset(cmd);
+	size_t length = __cmd_io_size(cmd);
+	size_t remaining = length;
 
 	while (remaining) {
-		size_t io_size;
-		void *vaddr;
-		size_t mem_offs = 0;
-
-		prp_offs++;
-		if (prp_offs == 1) {
-			paddr = cmd->prp1;
-		} else if (prp_offs == 2) {
-			paddr = cmd->prp2;
-			if (remaining > PAGE_SIZE) {
-				paddr_list = kmap_atomic_pfn(PRP_PFN(paddr)) +
-					     (paddr & PAGE_OFFSET_MASK);
-				paddr = paddr_list[prp2_offs++];
-			}
-		} else {
-			paddr = paddr_list[prp2_offs++];
-		}
+		size_t io_size = min_t(size_t, remaining, PAGE_SIZE);
 
-		vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
+		memcpy_flushcache(dst, zero_page, io_size);
 
-		io_size = min_t(size_t, remaining, PAGE_SIZE);
+		dst += io_size;
+		remaining -= io_size;
+	}
 
-		if (paddr & PAGE_OFFSET_MASK) {
-			mem_offs = paddr & PAGE_OFFSET_MASK;
-			if (io_size + mem_offs > PAGE_SIZE)
-				io_size = PAGE_SIZE - mem_offs;
-		}
+	return length;
+}
 
-		if (cmd->opcode == nvme_cmd_write ||
-		    cmd->opcode == nvme_cmd_zone_append) {
-			memcpy(nvmev_vdev->ns[nsid].mapped + offset, vaddr + mem_offs, io_size);
-		} else if (cmd->opcode == nvme_cmd_read) {
-			memcpy(vaddr + mem_offs, nvmev_vdev->ns[nsid].mapped + offset, io_size);
-		}
+static inline struct nvmev_dptr __cmd_dptr(struct nvme_rw_command *cmd)
+{
+	return (struct nvmev_dptr){
+		.flags = cmd->flags,
+		.dptr1 = cmd->prp1,
+		.dptr2 = cmd->prp2,
+		.length = __cmd_io_size(cmd),
+	};
+}
 
-		kunmap_atomic(vaddr);
+struct io_copy_ctx {
+	void *storage; /* start of the command in the storage */
+	bool to_dev;
+	bool nt;
+};
 
-		remaining -= io_size;
-		offset += io_size;
-	}
+static void __copy_extent_fn(size_t offs, u64 paddr, size_t len, void *arg)
+{
+	struct io_copy_ctx *ctx = arg;
 
-	if (paddr_list != NULL)
-		kunmap_atomic(paddr_list);
+	nvmev_copy_extent(ctx->to_dev, ctx->storage + offs, paddr, len, ctx->nt);
+}
 
-	return length;
+/* copy the bytes [pos, pos + len) of a read/write command */
+static void __do_perform_io_range(struct nvme_rw_command *cmd, size_t pos, size_t len)
+{
+	size_t nsid = cmd->nsid - 1; // 0-based
+	struct nvmev_dptr dptr = __cmd_dptr(cmd);
+	struct io_copy_ctx ctx = {
+		.storage = nvmev_vdev->ns[nsid].mapped + __cmd_io_offset(cmd),
+		.to_dev = (cmd->opcode == nvme_cmd_write || cmd->opcode == nvme_cmd_zone_append),
+		.nt = (__cmd_io_size(cmd) >= IO_NT_COPY_SIZE),
+	};
+
+	dptr_for_each_extent(&dptr, pos, len, __copy_extent_fn, &ctx);
 }
 
-static u64 paddr_list[513] = {
-	0,
-}; // Not using index 0 to make max index == num_prp
-static unsigned int __do_perform_io_using_dma(int sqid, int sq_entry)
+static unsigned int __do_perform_io(int sqid, int sq_entry)
 {
 	struct nvmev_submission_queue *sq = nvmev_vdev->sqes[sqid];
 	struct nvme_rw_command *cmd = &sq_entry(sq_entry).rw;
-	size_t offset;
-	size_t length, remaining;
-	int prp_offs = 0;
-	int prp2_offs = 0;
-	int num_prps = 0;
-	u64 paddr;
-	u64 *tmp_paddr_list = NULL;
-	size_t io_size;
-	size_t mem_offs = 0;
-
-	offset = __cmd_io_offset(cmd);
-	length = __cmd_io_size(cmd);
-	remaining = length;
-
-	memset(paddr_list, 0, sizeof(paddr_list));
-	/* Loop to get the PRP list */
-	while (remaining) {
-		io_size = 0;
-
-		prp_offs++;
-		if (prp_offs == 1) {
-			paddr_list[prp_offs] = cmd->prp1;
-		} else if (prp_offs == 2) {
-			paddr_list[prp_offs] = cmd->prp2;
-			if (remaining > PAGE_SIZE) {
-				tmp_paddr_list = kmap_atomic_pfn(PRP_PFN(paddr_list[prp_offs])) +
-						 (paddr_list[prp_offs] & PAGE_OFFSET_MASK);
-				paddr_list[prp_offs] = tmp_paddr_list[prp2_offs++];
-			}
-		} else {
-			paddr_list[prp_offs] = tmp_paddr_list[prp2_offs++];
-		}
+	size_t length = __cmd_io_size(cmd);
 
-		io_size = min_t(size_t, remaining, PAGE_SIZE);
+	if (cmd->opcode == nvme_cmd_write_zeroes)
+		return __do_perform_io_write_zeroes(sqid, sq_entry);
+	else if (cmd->opcode == nvme_cmd_write_uncor)
+		return 0;
 
-		if (paddr_list[prp_offs] & PAGE_OFFSET_MASK) {
-			mem_offs = paddr_list[prp_offs] & PAGE_OFFSET_MASK;
-			if (io_size + mem_offs > PAGE_SIZE)
-				io_size = PAGE_SIZE - mem_offs;
-		}
+	if (cmd->opcode == nvme_cmd_write || cmd->opcode == nvme_cmd_zone_append ||
+	    cmd->opcode == nvme_cmd_read)
+		__do_perform_io_range(cmd, 0, length);
 
-		remaining -= io_size;
+	return length;
+}
+
+/* claim the next chunk of the command @owner has published for helpers */
+static struct nvmev_io_work *__claim_copy_chunk(struct nvmev_io_worker *owner,
+					       unsigned int *chunk)
+{
+	struct nvmev_io_work *w;
+
+	spin_lock(&owner->copy_lock);
+	w = owner->copy_work;
+	if (w) {
+		*chunk = w->next_chunk++;
+		if (w->next_chunk == w->nr_chunks)
+			owner->copy_work = NULL;
 	}
-	num_prps = prp_offs;
+	spin_unlock(&owner->copy_lock);
 
-	if (tmp_paddr_list != NULL)
-		kunmap_atomic(tmp_paddr_list);
+	return w;
+}
 
-	remaining = length;
-	prp_offs = 1;
+static void __copy_chunk(struct nvmev_io_work *w, unsigned int chunk)
+{
+	struct nvmev_submission_queue *sq = nvmev_vdev->sqes[w->sqid];
+	struct nvme_rw_command *cmd = &sq_entry(w->sq_entry).rw;
+	size_t pos = (size_t)chunk * IO_COPY_CHUNK_SIZE;
 
-	/* Loop for data transfer */
-	while (remaining) {
-		size_t page_size;
-		mem_offs = 0;
-		io_size = 0;
-		page_size = 0;
-
-		paddr = paddr_list[prp_offs];
-		page_size = min_t(size_t, remaining, PAGE_SIZE);
-
-		/* For non-page aligned paddr, it will never be between continuous PRP list (Always first paddr)  */
-		if (paddr & PAGE_OFFSET_MASK) {
-			mem_offs = paddr & PAGE_OFFSET_MASK;
-			if (page_size + mem_offs > PAGE_SIZE) {
-				page_size = PAGE_SIZE - mem_offs;
-			}
+	__do_perform_io_range(cmd, pos, min_t(size_t, __cmd_io_size(cmd) - pos, IO_COPY_CHUNK_SIZE));
+
+	smp_mb__before_atomic(); /* owner shall see the data once the chunk is counted */
+	atomic_inc(&w->chunks_done);
+}
+
+/*
+ * Large commands are split into chunks. The owning worker publishes the
+ * command so that other workers can copy chunks too, and keeps copying
+ * itself. Returns true once every chunk has been copied.
+ */
+static bool __do_perform_io_chunks(struct nvmev_io_worker *worker, struct nvmev_io_work *w)
+{
+	struct nvmev_io_work *cw;
+	unsigned int chunk;
+
+	if (w->next_chunk == 0) {
+		bool shared = false;
+
+		spin_lock(&worker->copy_lock);
+		if (!worker->copy_work) {
+			worker->copy_work = w;
+			shared = true;
 		}
+		spin_unlock(&worker->copy_lock);
 
-		for (prp_offs++; prp_offs <= num_prps; prp_offs++) {
-			if (paddr_list[prp_offs] == paddr_list[prp_offs - 1] + PAGE_SIZE)
-				page_size += PAGE_SIZE;
-			else
-				break;
+		/* another command is being shared, nobody else will see this one */
+		if (!shared) {
+			while (w->next_chunk < w->nr_chunks)
+				__copy_chunk(w, w->next_chunk++);
 		}
+	}
 
-		io_size = min_t(size_t, remaining, page_size);
+	while ((cw = __claim_copy_chunk(worker, &chunk)))
+		__copy_chunk(cw, chunk);
 
-		if (cmd->opcode == nvme_cmd_write ||
-		    cmd->opcode == nvme_cmd_zone_append) {
-			ioat_dma_submit(paddr, nvmev_vdev->config.storage_start + offset, io_size);
-		} else if (cmd->opcode == nvme_cmd_read) {
-			ioat_dma_submit(nvmev_vdev->config.storage_start + offset, paddr, io_size);
-		}
+	if (atomic_read(&w->chunks_done) < w->nr_chunks)
+		return false;
 
-		remaining -= io_size;
-		offset += io_size;
+	smp_rmb();
+	return true;
+}
+
+/* copy one chunk of each command other workers are sharing */
+static void __steal_copy_chunks(struct nvmev_io_worker *worker)
+{
+	unsigned int i;
+
+	for (i = 0; i < nvmev_vdev->config.nr_io_workers; i++) {
+		struct nvmev_io_worker *owner = &nvmev_vdev->io_workers[i];
+		struct nvmev_io_work *w;
+		unsigned int chunk;
+
+		if (owner == worker || !READ_ONCE(owner->copy_work))
+			continue;
+
+		w = __claim_copy_chunk(owner, &chunk);
+		if (w)
+			__copy_chunk(w, chunk);
 	}
+}
 
-	return length;
+static void __dma_put(struct nvmev_io_work *w)
+{
+	if (atomic_dec_and_test(&w->dma_pending)) {
+		smp_wmb(); /* IO worker shall see the data once copied */
+		WRITE_ONCE(w->is_copied, true);
+	}
+}
+
+static void __dma_complete(void *param)
+{
+	__dma_put(param);
+}
+
+struct io_dma_ctx {
+	struct nvmev_io_work *w;
+	void *chan;
+	struct io_copy_ctx copy;
+	dma_addr_t storage; /* start of the command in the storage */
+};
+
+static void __dma_extent_fn(size_t offs, u64 paddr, size_t len, void *arg)
+{
+	struct io_dma_ctx *ctx = arg;
+	struct nvmev_dma_desc desc = {
+		.host = paddr,
+		.dev = ctx->storage + offs,
+		.dev_vaddr = ctx->copy.storage + offs,
+		.len = len,
+		.to_dev = ctx->copy.to_dev,
+		.callback = __dma_complete,
+		.param = ctx->w,
+	};
+
+	atomic_inc(&ctx->w->dma_pending);
+	if (nvmev_dma->submit(ctx->chan, &desc) != 0) {
+		/* the backend is out of descriptors, copy this extent by hand */
+		__copy_extent_fn(offs, paddr, len, &ctx->copy);
+		__dma_put(ctx->w);
+	}
+}
+
+/*
+ * Queue the whole command on the worker's DMA channel and return at once.
+ * The completion of the last descriptor marks the work copied, so the worker
+ * keeps serving other commands while the backend copies.
+ */
+static void __do_perform_io_using_dma(struct nvmev_io_worker *worker, struct nvmev_io_work *w)
+{
+	struct nvmev_submission_queue *sq = nvmev_vdev->sqes[w->sqid];
+	struct nvme_rw_command *cmd = &sq_entry(w->sq_entry).rw;
+	size_t nsid = cmd->nsid - 1; // 0-based
+	struct nvmev_dptr dptr = __cmd_dptr(cmd);
+	struct io_dma_ctx ctx = {
+		.w = w,
+		.chan = nvmev_dma->get_chan(worker->id),
+		.copy = {
+			.storage = nvmev_vdev->ns[nsid].mapped + __cmd_io_offset(cmd),
+			.to_dev = (cmd->opcode == nvme_cmd_write ||
+				   cmd->opcode == nvme_cmd_zone_append),
+			.nt = (__cmd_io_size(cmd) >= IO_NT_COPY_SIZE),
+		},
+		.storage = nvmev_vdev->config.storage_start + nvmev_vdev->ns[nsid].start +
+			   __cmd_io_offset(cmd),
+	};
+
+	w->is_dma_submitted = true;
+
+	if (cmd->opcode != nvme_cmd_write && cmd->opcode != nvme_cmd_zone_append &&
+	    cmd->opcode != nvme_cmd_read) {
+		__do_perform_io(w->sqid, w->sq_entry);
+		w->is_copied = true;
+		return;
+	}
+
+	/* hold a reference until every extent is queued */
+	atomic_set(&w->dma_pending, 1);
+	dptr_for_each_extent(&dptr, 0, dptr.length, __dma_extent_fn, &ctx);
+	nvmev_dma->issue_pending(ctx.chan);
+	__dma_put(w);
 }
 
 static void __insert_req_sorted(unsigned int entry, struct nvmev_io_worker *worker,
@@ -278,6 +364,36 @@ static struct nvmev_io_worker *__allocate_work_queue_entry(int sqid, unsigned in
 	return worker;
 }
 
+/* a malformed SGL fails the command before the FTL sees it */
+static u16 __cmd_check_dptr(struct nvme_rw_command *cmd)
+{
+	struct nvmev_dptr dptr = __cmd_dptr(cmd);
+
+	if (cmd->opcode != nvme_cmd_write && cmd->opcode != nvme_cmd_zone_append &&
+	    cmd->opcode != nvme_cmd_read)
+		return NVME_SC_SUCCESS;
+
+	return dptr_check(&dptr);
+}
+
+/* number of chunks to share a command's copy in, 0 to copy it at once */
+static unsigned int __cmd_copy_chunks(struct nvme_rw_command *cmd)
+{
+	size_t length = __cmd_io_size(cmd);
+
+	if (io_using_dma || nvmev_vdev->config.nr_io_workers < 2 || BASE_SSD == KV_PROTOTYPE)
+		return 0;
+
+	if (cmd->opcode != nvme_cmd_write && cmd->opcode != nvme_cmd_zone_append &&
+	    cmd->opcode != nvme_cmd_read)
+		return 0;
+
+	if (length <= IO_COPY_CHUNK_SIZE)
+		return 0;
+
+	return DIV_ROUND_UP(length, IO_COPY_CHUNK_SIZE);
+}
+
 static void __enqueue_io_req(int sqid, int cqid, int sq_entry, unsigned long long nsecs_start,
 			     struct nvmev_result *ret)
 {
@@ -302,11 +418,16 @@ static void __enqueue_io_req(int sqid, int cqid, int sq_entry, unsigned long lon
 	w->sq_entry = sq_entry;
 	w->command_id = sq_entry(sq_entry).common.command_id;
 	w->nsecs_start = nsecs_start;
-	w->nsecs_enqueue = local_clock();
+	w->nsecs_enqueue = nvmev_clock();
 	w->nsecs_target = ret->nsecs_target;
 	w->status = ret->status;
 	w->is_completed = false;
-	w->is_copied = false;
+	/* a command that failed up front moves no data */
+	w->is_copied = (ret->status != NVME_SC_SUCCESS);
+	w->is_dma_submitted = false;
+	w->nr_chunks = w->is_copied ? 0 : __cmd_copy_chunks(&sq_entry(sq_entry).rw);
+	w->next_chunk = 0;
+	atomic_set(&w->chunks_done, 0);
 	w->prev = -1;
 	w->next = -1;
 
@@ -330,14 +451,15 @@ void schedule_internal_operation(int sqid, unsigned long long nsecs_target,
 	w = worker->work_queue + entry;
 
 	NVMEV_DEBUG_VERBOSE("%s/%u, internal sq %d, %llu + %llu\n", worker->thread_name, entry, sqid,
-		    local_clock(), nsecs_target - local_clock());
+		    nvmev_clock(), nsecs_target - nvmev_clock());
 
 	/////////////////////////////////
 	w->sqid = sqid;
-	w->nsecs_start = w->nsecs_enqueue = local_clock();
+	w->nsecs_start = w->nsecs_enqueue = nvmev_clock();
 	w->nsecs_target = nsecs_target;
 	w->is_completed = false;
 	w->is_copied = true;
+	w->nr_chunks = 0;
 	w->prev = -1;
 	w->next = -1;
 
@@ -348,6 +470,29 @@ void schedule_internal_operation(int sqid, unsigned long long nsecs_target,
 	__insert_req_sorted(entry, worker, nsecs_target);
 }
 
+/*
+ * Wait until the io workers have completed all the work queued so far. Work
+ * is only queued by the dispatcher, which runs this, so the wait is bounded
+ * by the latest target time already handed out.
+ */
+void nvmev_drain_io_workers(void)
+{
+	unsigned int turn;
+
+	for (turn = 0; turn < nvmev_vdev->config.nr_io_workers; turn++) {
+		struct nvmev_io_worker *worker = &nvmev_vdev->io_workers[turn];
+		unsigned int curr = worker->io_seq;
+
+		while (curr != -1) {
+			struct nvmev_io_work *w = &worker->work_queue[curr];
+
+			while (!READ_ONCE(w->is_completed))
+				cond_resched();
+			curr = w->next;
+		}
+	}
+}
+
 static void __reclaim_completed_reqs(void)
 {
 	unsigned int turn;
@@ -399,17 +544,17 @@ static void __reclaim_completed_reqs(void)
 	}
 }
 
-static size_t __nvmev_proc_io(int sqid, int sq_entry, size_t *io_size)
+static size_t __nvmev_proc_io(int sqid, int sq_entry, unsigned long long nsecs_start,
+			      size_t *io_size)
 {
 	struct nvmev_submission_queue *sq = nvmev_vdev->sqes[sqid];
-	unsigned long long nsecs_start = __get_wallclock();
 	struct nvme_command *cmd = &sq_entry(sq_entry);
 #if (BASE_SSD == KV_PROTOTYPE)
 	uint32_t nsid = 0; // Some KVSSD programs give 0 as nsid for KV IO
 #else
 	uint32_t nsid = cmd->common.nsid - 1;
 #endif
-	struct nvmev_ns *ns = &nvmev_vdev->ns[nsid];
+	struct nvmev_ns *ns = NULL;
 
 	struct nvmev_request req = {
 		.cmd = cmd,
@@ -432,7 +577,15 @@ static size_t __nvmev_proc_io(int sqid, int sq_entry, size_t *io_size)
 	static unsigned long long counter = 0;
 #endif
 
-	if (!ns->proc_io_cmd(ns, &req, &ret))
+	if (nsid < nvmev_vdev->nr_ns && nvmev_vdev->ns[nsid].attached)
+		ns = &nvmev_vdev->ns[nsid];
+
+	if (!ns)
+		ret.status = NVME_SC_INVALID_NS;
+	else
+		ret.status = __cmd_check_dptr(&cmd->rw);
+
+	if (ret.status == NVME_SC_SUCCESS && !ns->proc_io_cmd(ns, &req, &ret))
 		return false;
 	*io_size = __cmd_io_size(&sq_entry(sq_entry).rw);
 
@@ -475,15 +628,20 @@ int nvmev_proc_io_sq(int sqid, int new_db, int old_db)
 	int seq;
 	int sq_entry = old_db;
 	int latest_db;
+	unsigned long long nsecs_start;
 
 	if (unlikely(!sq))
 		return old_db;
 	if (unlikely(num_proc < 0))
 		num_proc += sq->queue_size;
 
+	/* all commands of a doorbell batch arrive at the same device time */
+	nsecs_start = nvmev_clock();
+	nvmev_vdev->nsecs_batch = nsecs_start;
+
 	for (seq = 0; seq < num_proc; seq++) {
 		size_t io_size;
-		if (!__nvmev_proc_io(sqid, sq_entry, &io_size))
+		if (!__nvmev_proc_io(sqid, sq_entry, nsecs_start, &io_size))
 			break;
 
 		if (++sq_entry == sq->queue_size) {
@@ -572,16 +730,12 @@ static int nvmev_io_worker(void *data)
 		   cpu_to_node(smp_processor_id()));
 
 	while (!kthread_should_stop()) {
-		unsigned long long curr_nsecs_wall = __get_wallclock();
-		unsigned long long curr_nsecs_local = local_clock();
-		long long delta = curr_nsecs_wall - curr_nsecs_local;
-
+		unsigned long long curr_nsecs = nvmev_clock();
 		volatile unsigned int curr = worker->io_seq;
 		int qidx;
 
 		while (curr != -1) {
 			struct nvmev_io_work *w = &worker->work_queue[curr];
-			unsigned long long curr_nsecs = local_clock() + delta;
 			worker->latest_nsecs = curr_nsecs;
 
 			if (w->is_completed == true) {
@@ -591,12 +745,25 @@ static int nvmev_io_worker(void *data)
 
 			if (w->is_copied == false) {
 #ifdef PERF_DEBUG
-				w->nsecs_copy_start = local_clock() + delta;
+				w->nsecs_copy_start = nvmev_clock();
 #endif
 				if (w->is_internal) {
 					;
+				} else if (w->nr_chunks) {
+					if (!__do_perform_io_chunks(worker, w)) {
+						/* other workers still copy some chunks */
+						curr = w->next;
+						continue;
+					}
 				} else if (io_using_dma) {
-					__do_perform_io_using_dma(w->sqid, w->sq_entry);
+					if (!w->is_dma_submitted)
+						__do_perform_io_using_dma(worker, w);
+					if (!READ_ONCE(w->is_copied)) {
+						/* the DMA engine is still copying */
+						curr = w->next;
+						continue;
+					}
+					smp_rmb();
 				} else {
 #if (BASE_SSD == KV_PROTOTYPE)
 					struct nvmev_submission_queue *sq =
@@ -614,9 +781,10 @@ static int nvmev_io_worker(void *data)
 				}
 
 #ifdef PERF_DEBUG
-				w->nsecs_copy_done = local_clock() + delta;
+				w->nsecs_copy_done = nvmev_clock();
 #endif
 				w->is_copied = true;
+				curr_nsecs = nvmev_clock(); /* copying took a while */
 				last_io_time = jiffies;
 
 				NVMEV_DEBUG_VERBOSE("%s: copied %u, %d %d %d\n", worker->thread_name, curr,
@@ -637,7 +805,7 @@ static int nvmev_io_worker(void *data)
 					    w->sqid, w->cqid, w->sq_entry);
 
 #ifdef PERF_DEBUG
-				w->nsecs_cq_filled = local_clock() + delta;
+				w->nsecs_cq_filled = nvmev_clock();
 				trace_printk("%llu %llu %llu %llu %llu %llu\n", w->nsecs_start,
 					     w->nsecs_enqueue - w->nsecs_start,
 					     w->nsecs_copy_start - w->nsecs_start,
@@ -652,6 +820,8 @@ static int nvmev_io_worker(void *data)
 			curr = w->next;
 		}
 
+		__steal_copy_chunks(worker);
+
 		for (qidx = 1; qidx <= nvmev_vdev->nr_cq; qidx++) {
 			struct nvmev_completion_queue *cq = nvmev_vdev->cqes[qidx];
 
@@ -718,6 +888,8 @@ void NVMEV_IO_WORKER_INIT(struct nvmev_dev *nvmev_vdev)
 		worker->free_seq_end = NR_MAX_PARALLEL_IO - 1;
 		worker->io_seq = -1;
 		worker->io_seq_end = -1;
+		spin_lock_init(&worker->copy_lock);
+		worker->copy_work = NULL;
 
 		snprintf(worker->thread_name, sizeof(worker->thread_name), "nvmev_io_worker_%d", worker_id);
 
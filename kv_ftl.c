@@ -1,11 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0-only
 
 #include <linux/ktime.h>
-#include <linux/highmem.h>
 #include <linux/sched/clock.h>
 
 #include "nvmev.h"
 #include "kv_ftl.h"
+#include "data_iter.h"
 
 static const struct allocator_ops append_only_ops = {
 	.init = append_only_allocator_init,
@@ -19,10 +19,6 @@ static const struct allocator_ops bitmap_ops = {
 	.kill = bitmap_kill,
 };
 
-static inline unsigned long long __get_wallclock(void)
-{
-	return cpu_clock(nvmev_vdev->config.cpu_nr_dispatcher);
-}
 
 static size_t __cmd_io_size(struct nvme_rw_command *cmd)
 {
@@ -32,6 +28,16 @@ static size_t __cmd_io_size(struct nvme_rw_command *cmd)
 	return (cmd->length + 1) << LBA_BITS;
 }
 
+static struct nvmev_dptr __kv_cmd_dptr(struct nvme_kv_command cmd, size_t length)
+{
+	return (struct nvmev_dptr){
+		.flags = cmd.common.flags,
+		.dptr1 = kv_io_cmd_value_prp(cmd, 1),
+		.dptr2 = kv_io_cmd_value_prp(cmd, 2),
+		.length = length,
+	};
+}
+
 static unsigned int cmd_key_length(struct nvme_kv_command cmd)
 {
 	if (cmd.common.opcode == nvme_cmd_kv_store) {
@@ -506,12 +512,8 @@ static unsigned int __do_perform_kv_io(struct kv_ftl *kv_ftl, struct nvme_kv_com
 				       unsigned int *status)
 {
 	size_t offset;
-	size_t length, remaining;
-	int prp_offs = 0;
-	int prp2_offs = 0;
-	u64 paddr;
-	u64 *paddr_list = NULL;
-	size_t mem_offs = 0;
+	size_t length;
+	struct nvmev_dptr dptr;
 	size_t new_offset = 0;
 	struct mapping_entry entry;
 	int is_insert = 0;
@@ -580,52 +582,10 @@ static unsigned int __do_perform_kv_io(struct kv_ftl *kv_ftl, struct nvme_kv_com
 
 		return 0;
 	}
-	remaining = length;
-
-	while (remaining) {
-		size_t io_size;
-		void *vaddr;
-
-		mem_offs = 0;
-		prp_offs++;
-		if (prp_offs == 1) {
-			paddr = kv_io_cmd_value_prp(cmd, 1);
-		} else if (prp_offs == 2) {
-			paddr = kv_io_cmd_value_prp(cmd, 2);
-			if (remaining > PAGE_SIZE) {
-				paddr_list = kmap_atomic_pfn(PRP_PFN(paddr)) +
-					     (paddr & PAGE_OFFSET_MASK);
-				paddr = paddr_list[prp2_offs++];
-			}
-		} else {
-			paddr = paddr_list[prp2_offs++];
-		}
-
-		vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
-
-		io_size = min_t(size_t, remaining, PAGE_SIZE);
-
-		if (paddr & PAGE_OFFSET_MASK) { // 일반 block io면 언제 여기에 해당?
-			mem_offs = paddr & PAGE_OFFSET_MASK;
-			if (io_size + mem_offs > PAGE_SIZE)
-				io_size = PAGE_SIZE - mem_offs;
-		}
-		if (cmd.common.opcode == nvme_cmd_kv_store) {
-			memcpy(nvmev_vdev->storage_mapped + offset, vaddr + mem_offs, io_size);
-		} else if (cmd.common.opcode == nvme_cmd_kv_retrieve) {
-			memcpy(vaddr + mem_offs, nvmev_vdev->storage_mapped + offset, io_size);
-		} else {
-			NVMEV_ERROR("Wrong KV Command passed to NVMeVirt!!\n");
-		}
-
-		kunmap_atomic(vaddr);
-
-		remaining -= io_size;
-		offset += io_size;
-	}
-
-	if (paddr_list != NULL)
-		kunmap_atomic(paddr_list);
+	/* the PRP layout follows the host buffer, not the value found */
+	dptr = __kv_cmd_dptr(cmd, cmd_value_length(cmd));
+	dptr_copy(&dptr, nvmev_vdev->storage_mapped + offset, length,
+		  cmd.common.opcode == nvme_cmd_kv_retrieve);
 
 	if (is_insert == 1) { // need to make new mapping
 		new_mapping_entry(kv_ftl, cmd, new_offset);
@@ -691,13 +651,8 @@ static unsigned int __do_perform_kv_batched_io(struct kv_ftl *kv_ftl, int opcode
 static unsigned int __do_perform_kv_batch(struct kv_ftl *kv_ftl, struct nvme_kv_command cmd,
 					  unsigned int *status)
 {
-	size_t offset;
-	size_t length, remaining;
-	int prp_offs = 0;
-	int prp2_offs = 0;
-	u64 paddr;
-	u64 *paddr_list = NULL;
-	size_t mem_offs = 0;
+	size_t length;
+	struct nvmev_dptr dptr;
 	int i;
 	struct payload_format *payload;
 	char *buffer = NULL;
@@ -714,47 +669,8 @@ static unsigned int __do_perform_kv_batch(struct kv_ftl *kv_ftl, struct nvme_kv_
 
 	//printk("kv_batch %d %d", sub_cmd_cnt, length);
 
-	remaining = length;
-	offset = 0;
-
-	while (remaining) {
-		size_t io_size;
-		void *vaddr;
-
-		mem_offs = 0;
-		prp_offs++;
-		if (prp_offs == 1) {
-			paddr = kv_io_cmd_value_prp(cmd, 1);
-		} else if (prp_offs == 2) {
-			paddr = kv_io_cmd_value_prp(cmd, 2);
-			if (remaining > PAGE_SIZE) {
-				paddr_list = kmap_atomic_pfn(PRP_PFN(paddr)) +
-					     (paddr & PAGE_OFFSET_MASK);
-				paddr = paddr_list[prp2_offs++];
-			}
-		} else {
-			paddr = paddr_list[prp2_offs++];
-		}
-
-		vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
-
-		io_size = min_t(size_t, remaining, PAGE_SIZE);
-
-		if (paddr & PAGE_OFFSET_MASK) { // 일반 block io면 언제 여기에 해당?
-			mem_offs = paddr & PAGE_OFFSET_MASK;
-			if (io_size + mem_offs > PAGE_SIZE)
-				io_size = PAGE_SIZE - mem_offs;
-		}
-
-		NVMEV_DEBUG("Value write length %lu to position %lu, io size: %ld, mem_off: %lu\n",
-			    remaining, offset, io_size, mem_offs);
-		memcpy(buffer + offset, vaddr + mem_offs, io_size);
-
-		kunmap_atomic(vaddr);
-
-		remaining -= io_size;
-		offset += io_size;
-	}
+	dptr = __kv_cmd_dptr(cmd, length);
+	dptr_copy(&dptr, buffer, length, false);
 
 	/* perform KV IO for sub-payload */
 	payload = (struct payload_format *)buffer;
@@ -784,9 +700,6 @@ static unsigned int __do_perform_kv_batch(struct kv_ftl *kv_ftl, struct nvme_kv_
 
 	NVMEV_DEBUG("finished kv_batch with %d sub-commands", sub_cmd_cnt);
 
-	if (paddr_list != NULL)
-		kunmap_atomic(paddr_list);
-
 	if (value != NULL)
 		kfree(value);
 
@@ -847,10 +760,7 @@ static unsigned int kv_iter_read(struct kv_ftl *kv_ftl, struct nvme_kv_command c
 	int pos = 0, keylen = 16, buf_offset = 4, nr_keys = 0;
 	unsigned int key;
 	bool full = false, end = false;
-	size_t remaining, mem_offs = 0, offset;
-	int prp_offs = 0, prp2_offs = 0;
-	u64 paddr;
-	u64 *paddr_list = NULL;
+	struct nvmev_dptr dptr;
 
 	if (handle == NULL) {
 		NVMEV_ERROR("Invalid Iterator Handle");
@@ -893,51 +803,8 @@ static unsigned int kv_iter_read(struct kv_ftl *kv_ftl, struct nvme_kv_command c
 	handle->current_pos = pos;
 
 	/* Writing buffer to PRP */
-	remaining = buf_offset;
-	offset = 0;
-
-	while (remaining) {
-		size_t io_size;
-		void *vaddr;
-
-		mem_offs = 0;
-		prp_offs++;
-		if (prp_offs == 1) {
-			paddr = kv_io_cmd_value_prp(cmd, 1);
-		} else if (prp_offs == 2) {
-			paddr = kv_io_cmd_value_prp(cmd, 2);
-			if (remaining > PAGE_SIZE) {
-				paddr_list = kmap_atomic_pfn(PRP_PFN(paddr)) +
-					     (paddr & PAGE_OFFSET_MASK);
-				paddr = paddr_list[prp2_offs++];
-			}
-		} else {
-			paddr = paddr_list[prp2_offs++];
-		}
-
-		vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
-
-		io_size = min_t(size_t, remaining, PAGE_SIZE);
-
-		if (paddr & PAGE_OFFSET_MASK) {
-			mem_offs = paddr & PAGE_OFFSET_MASK;
-			if (io_size + mem_offs > PAGE_SIZE)
-				io_size = PAGE_SIZE - mem_offs;
-		}
-
-		NVMEV_DEBUG(
-			"Buffer transfer, length %lu from position %lu, io size: %ld, mem_off: %lu\n",
-			remaining, offset, io_size, mem_offs);
-		memcpy(vaddr + mem_offs, handle->buf + offset, io_size);
-
-		kunmap_atomic(vaddr);
-
-		remaining -= io_size;
-		offset += io_size;
-	}
-
-	if (paddr_list != NULL)
-		kunmap_atomic(paddr_list);
+	dptr = __kv_cmd_dptr(cmd, buf_offset);
+	dptr_copy(&dptr, handle->buf, buf_offset, true);
 
 	*status = 0;
 	if (end) {
@@ -972,7 +839,7 @@ bool kv_proc_nvme_io_cmd(struct nvmev_ns *ns, struct nvmev_request *req, struct
 	case nvme_cmd_read:
 		ret->nsecs_target = __schedule_io_units(
 			cmd->common.opcode, cmd->rw.slba,
-			__cmd_io_size((struct nvme_rw_command *)cmd), __get_wallclock());
+			__cmd_io_size((struct nvme_rw_command *)cmd), req->nsecs_start);
 		break;
 	case nvme_cmd_flush:
 		ret->nsecs_target = __schedule_flush(req);
@@ -982,9 +849,9 @@ bool kv_proc_nvme_io_cmd(struct nvmev_ns *ns, struct nvmev_request *req, struct
 	case nvme_cmd_kv_batch:
 		ret->nsecs_target = __schedule_io_units(
 			cmd->common.opcode, 0, cmd_value_length(*((struct nvme_kv_command *)cmd)),
-			__get_wallclock());
+			req->nsecs_start);
 		NVMEV_INFO("%d, %llu, %llu\n", cmd_value_length(*((struct nvme_kv_command *)cmd)),
-			   __get_wallclock(), ret->nsecs_target);
+			   req->nsecs_start, ret->nsecs_target);
 		break;
 	default:
 		NVMEV_ERROR("%s: command not implemented: %s (0x%x)\n", __func__,
@@ -2,11 +2,13 @@
 
 #include <linux/kernel.h>
 #include <linux/kthread.h>
+#include <linux/log2.h>
 #include <linux/types.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/smp.h>
 #include <linux/delay.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
@@ -45,6 +47,14 @@
  *
  * Storage area
  *
+ * With cmb_size set, the CMB follows the metadata at offset cmb_size and
+ * is part of BAR0, so the metadata area grows to 2 * cmb_size:
+ *
+ * +--------------+--------------+---------------------------+
+ * | <-cmb_size-> | <-cmb_size-> | <----- Storage Area ----> |
+ * |   metadata   |     CMB      |                           |
+ * +--------------+--------------+---------------------------+
+ *
  ****************************************************************/
 
 /****************************************************************
@@ -58,6 +68,7 @@ struct nvmev_dev *nvmev_vdev = NULL;
 
 static unsigned long memmap_start = 0;
 static unsigned long memmap_size = 0;
+static unsigned long cmb_size = 0;
 
 static unsigned int read_time = 1;
 static unsigned int read_delay = 1;
@@ -74,6 +85,7 @@ static char *cpus;
 static unsigned int debug = 0;
 
 int io_using_dma = false;
+static char *dma_backend = "ioat";
 
 static int set_parse_mem_param(const char *val, const struct kernel_param *kp)
 {
@@ -91,6 +103,8 @@ module_param_cb(memmap_start, &ops_parse_mem_param, &memmap_start, 0444);
 MODULE_PARM_DESC(memmap_start, "Reserved memory address");
 module_param_cb(memmap_size, &ops_parse_mem_param, &memmap_size, 0444);
 MODULE_PARM_DESC(memmap_size, "Reserved memory size");
+module_param_cb(cmb_size, &ops_parse_mem_param, &cmb_size, 0444);
+MODULE_PARM_DESC(cmb_size, "Controller memory buffer size carved from the reserved memory, 0 disables it");
 module_param(read_time, uint, 0644);
 MODULE_PARM_DESC(read_time, "Read time in nanoseconds");
 module_param(read_delay, uint, 0644);
@@ -109,6 +123,10 @@ module_param(io_unit_shift, uint, 0444);
 MODULE_PARM_DESC(io_unit_shift, "Size of each I/O unit (2^)");
 module_param(cpus, charp, 0444);
 MODULE_PARM_DESC(cpus, "CPU list for process, completion(int.) threads, Seperated by Comma(,)");
+module_param(io_using_dma, int, 0444);
+MODULE_PARM_DESC(io_using_dma, "Copy data through a DMA backend instead of the io workers");
+module_param(dma_backend, charp, 0444);
+MODULE_PARM_DESC(dma_backend, "DMA backend to use: ioat (dmaengine) or memcpy (copy threads)");
 module_param(debug, uint, 0644);
 
 // Returns true if an event is processed
@@ -164,6 +182,31 @@ static bool nvmev_proc_dbs(void)
 	return updated;
 }
 
+DEFINE_PER_CPU(long long, nvmev_clock_offs);
+
+/* runs on every online cpu, so both clocks are read at the same instant there */
+static void __nvmev_clock_calibrate(void *data)
+{
+	int cpu_base = *(int *)data;
+
+	__this_cpu_write(nvmev_clock_offs, cpu_clock(cpu_base) - local_clock());
+}
+
+void nvmev_clock_init(int cpu_base)
+{
+	unsigned int cpu;
+
+	if (cpu_base < 0)
+		cpu_base = raw_smp_processor_id();
+
+	/* a rough offset for cpus that are not online yet */
+	for_each_possible_cpu(cpu) {
+		per_cpu(nvmev_clock_offs, cpu) = cpu_clock(cpu_base) - cpu_clock(cpu);
+	}
+
+	on_each_cpu(__nvmev_clock_calibrate, &cpu_base, 1);
+}
+
 static int nvmev_dispatcher(void *data)
 {
 	static unsigned long last_dispatched_time = 0;
@@ -250,10 +293,30 @@ static int __validate_configs(void)
 		return -EINVAL;
 	}
 
+	if (cmb_size) {
+		if (!is_power_of_2(cmb_size) || cmb_size < MB(1) || cmb_size > GB(1UL)) {
+			NVMEV_ERROR("[cmb_size] should be a power of 2 between 1 MiB and 1 GiB\n");
+			return -EINVAL;
+		}
+		if (memmap_start & (cmb_size * 2 - 1)) {
+			NVMEV_ERROR("[memmap_start] should be aligned to twice the CMB size\n");
+			return -EINVAL;
+		}
+		if (memmap_size <= cmb_size * 2) {
+			NVMEV_ERROR("[memmap_size] should be bigger than twice the CMB size\n");
+			return -EINVAL;
+		}
+	}
+
 	if (__validate_configs_arch()) {
 		return -EPERM;
 	}
 
+#if (SUPPORTED_SSD_TYPE(CONV) || SUPPORTED_SSD_TYPE(ZNS))
+	if (ssd_check_profile())
+		return -EINVAL;
+#endif
+
 	if (nr_io_units == 0 || io_unit_shift == 0) {
 		NVMEV_ERROR("Need non-zero IO unit size and at least one IO unit\n");
 		return -EINVAL;
@@ -345,6 +408,23 @@ static int __proc_file_read(struct seq_file *m, void *data)
 		/* Left for later use */
 	} else if (strcmp(filename, "waf") == 0) {
 		seq_printf(m, "user_write: %llu, device_write: %llu\n", nvmev_vdev->user_write, nvmev_vdev->device_write);
+	} else if (strcmp(filename, "read_retry") == 0) {
+		seq_printf(m, "nand_reads: %lld, read_retries: %lld, soft_decodes: %lld\n",
+			   atomic64_read(&nvmev_vdev->nr_nand_reads),
+			   atomic64_read(&nvmev_vdev->nr_read_retries),
+			   atomic64_read(&nvmev_vdev->nr_soft_decodes));
+	} else if (strcmp(filename, "read_cache") == 0) {
+		seq_printf(m, "hits: %lld, misses: %lld, readahead: %lld, readahead_hits: %lld\n",
+			   atomic64_read(&nvmev_vdev->rc_hits), atomic64_read(&nvmev_vdev->rc_misses),
+			   atomic64_read(&nvmev_vdev->ra_issued), atomic64_read(&nvmev_vdev->ra_useful));
+	} else if (strcmp(filename, "l2p_cache") == 0) {
+		seq_printf(m, "hmb: %s (%u KiB), hits: %lld, misses: %lld, writebacks: %lld\n",
+			   nvmev_vdev->hmb_enabled ? "on" : "off", nvmev_vdev->hmb_size * 4,
+			   atomic64_read(&nvmev_vdev->l2p_hits), atomic64_read(&nvmev_vdev->l2p_misses),
+			   atomic64_read(&nvmev_vdev->l2p_writebacks));
+		seq_printf(m, "cmt hits: %lld, misses: %lld, writebacks: %lld\n",
+			   atomic64_read(&nvmev_vdev->cmt_hits), atomic64_read(&nvmev_vdev->cmt_misses),
+			   atomic64_read(&nvmev_vdev->cmt_writebacks));
 	}
 
 	return 0;
@@ -399,6 +479,22 @@ static ssize_t __proc_file_write(struct file *file, const char __user *buf, size
 		nvmev_vdev->user_write = 0;
 		nvmev_vdev->device_write = 0;
 		printk("reset waf\n");
+	} else if (strcmp(filename, "read_retry") == 0) {
+		atomic64_set(&nvmev_vdev->nr_nand_reads, 0);
+		atomic64_set(&nvmev_vdev->nr_read_retries, 0);
+		atomic64_set(&nvmev_vdev->nr_soft_decodes, 0);
+	} else if (strcmp(filename, "read_cache") == 0) {
+		atomic64_set(&nvmev_vdev->rc_hits, 0);
+		atomic64_set(&nvmev_vdev->rc_misses, 0);
+		atomic64_set(&nvmev_vdev->ra_issued, 0);
+		atomic64_set(&nvmev_vdev->ra_useful, 0);
+	} else if (strcmp(filename, "l2p_cache") == 0) {
+		atomic64_set(&nvmev_vdev->l2p_hits, 0);
+		atomic64_set(&nvmev_vdev->l2p_misses, 0);
+		atomic64_set(&nvmev_vdev->l2p_writebacks, 0);
+		atomic64_set(&nvmev_vdev->cmt_hits, 0);
+		atomic64_set(&nvmev_vdev->cmt_misses, 0);
+		atomic64_set(&nvmev_vdev->cmt_writebacks, 0);
 	}
 
 out:
@@ -437,6 +533,12 @@ static void NVMEV_STORAGE_INIT(struct nvmev_dev *nvmev_vdev)
 			nvmev_vdev->config.storage_start + nvmev_vdev->config.storage_size,
 			BYTE_TO_MB(nvmev_vdev->config.storage_size));
 
+	if (nvmev_vdev->config.cmb_size) {
+		NVMEV_INFO("CMB: %#010lx-%#010lx (%lu MiB)\n", nvmev_vdev->config.cmb_start,
+			   nvmev_vdev->config.cmb_start + nvmev_vdev->config.cmb_size,
+			   BYTE_TO_MB(nvmev_vdev->config.cmb_size));
+	}
+
 	nvmev_vdev->io_unit_stat = kzalloc(
 		sizeof(*nvmev_vdev->io_unit_stat) * nvmev_vdev->config.nr_io_units, GFP_KERNEL);
 
@@ -456,6 +558,12 @@ static void NVMEV_STORAGE_INIT(struct nvmev_dev *nvmev_vdev)
 	nvmev_vdev->proc_stat = proc_create("stat", 0444, nvmev_vdev->proc_root, &proc_file_fops);
 	nvmev_vdev->proc_debug = proc_create("debug", 0444, nvmev_vdev->proc_root, &proc_file_fops);
 	nvmev_vdev->proc_waf = proc_create("waf", 0664, nvmev_vdev->proc_root, &proc_file_fops);
+	nvmev_vdev->proc_read_retry =
+		proc_create("read_retry", 0664, nvmev_vdev->proc_root, &proc_file_fops);
+	nvmev_vdev->proc_read_cache =
+		proc_create("read_cache", 0664, nvmev_vdev->proc_root, &proc_file_fops);
+	nvmev_vdev->proc_l2p_cache =
+		proc_create("l2p_cache", 0664, nvmev_vdev->proc_root, &proc_file_fops);
 }
 
 static void NVMEV_STORAGE_FINAL(struct nvmev_dev *nvmev_vdev)
@@ -466,6 +574,9 @@ static void NVMEV_STORAGE_FINAL(struct nvmev_dev *nvmev_vdev)
 	remove_proc_entry("stat", nvmev_vdev->proc_root);
 	remove_proc_entry("debug", nvmev_vdev->proc_root);
 	remove_proc_entry("waf", nvmev_vdev->proc_root);
+	remove_proc_entry("read_retry", nvmev_vdev->proc_root);
+	remove_proc_entry("read_cache", nvmev_vdev->proc_root);
+	remove_proc_entry("l2p_cache", nvmev_vdev->proc_root);
 
 	remove_proc_entry("nvmev", NULL);
 
@@ -492,9 +603,17 @@ static bool __load_configs(struct nvmev_config *config)
 
 	config->memmap_start = memmap_start;
 	config->memmap_size = memmap_size;
-	// storage space starts from 1M offset
-	config->storage_start = memmap_start + MB(1);
-	config->storage_size = memmap_size - MB(1);
+	if (cmb_size) {
+		// CMB follows the metadata, storage follows the CMB
+		config->cmb_start = memmap_start + cmb_size;
+		config->cmb_size = cmb_size;
+		config->storage_start = config->cmb_start + cmb_size;
+		config->storage_size = memmap_size - cmb_size * 2;
+	} else {
+		// storage space starts from 1M offset
+		config->storage_start = memmap_start + MB(1);
+		config->storage_size = memmap_size - MB(1);
+	}
 
 	config->read_time = read_time;
 	config->read_delay = read_delay;
@@ -522,64 +641,203 @@ static bool __load_configs(struct nvmev_config *config)
 	return true;
 }
 
-static void NVMEV_NAMESPACE_INIT(struct nvmev_dev *nvmev_vdev)
+/* 0 on success, or -ENOMEM if the FTL could not allocate its state */
+static int __init_namespace(struct nvmev_ns *ns, uint32_t id, uint32_t ssd_type, uint64_t size,
+			    void *addr)
 {
-	unsigned long long remaining_capacity = nvmev_vdev->config.storage_size;
-	void *ns_addr = nvmev_vdev->storage_mapped;
-	const int nr_ns = NR_NAMESPACES; // XXX: allow for dynamic nr_ns
 	const unsigned int disp_no = nvmev_vdev->config.cpu_nr_dispatcher;
+
+	switch (ssd_type) {
+#if SUPPORTED_SSD_TYPE(NVM)
+	case SSD_TYPE_NVM:
+		simple_init_namespace(ns, id, size, addr, disp_no);
+		break;
+#endif
+#if SUPPORTED_SSD_TYPE(CONV)
+	case SSD_TYPE_CONV:
+		return conv_init_namespace(ns, id, size, addr, disp_no);
+#endif
+#if SUPPORTED_SSD_TYPE(ZNS)
+	case SSD_TYPE_ZNS:
+		zns_init_namespace(ns, id, size, addr, disp_no);
+		break;
+#endif
+#if SUPPORTED_SSD_TYPE(KV)
+	case SSD_TYPE_KV:
+		kv_init_namespace(ns, id, size, addr, disp_no);
+		break;
+#endif
+	default:
+		BUG_ON(1);
+	}
+
+	return 0;
+}
+
+static void __remove_namespace(struct nvmev_ns *ns)
+{
+	switch (ns->ssd_type) {
+#if SUPPORTED_SSD_TYPE(NVM)
+	case SSD_TYPE_NVM:
+		simple_remove_namespace(ns);
+		break;
+#endif
+#if SUPPORTED_SSD_TYPE(CONV)
+	case SSD_TYPE_CONV:
+		conv_remove_namespace(ns);
+		break;
+#endif
+#if SUPPORTED_SSD_TYPE(ZNS)
+	case SSD_TYPE_ZNS:
+		zns_remove_namespace(ns);
+		break;
+#endif
+#if SUPPORTED_SSD_TYPE(KV)
+	case SSD_TYPE_KV:
+		kv_remove_namespace(ns);
+		break;
+#endif
+	default:
+		BUG_ON(1);
+	}
+}
+
+/* the part of @size the FTL of @ssd_type can use, 0 if it is too small */
+static uint64_t __fit_namespace_size(uint32_t ssd_type, uint64_t size)
+{
+	switch (ssd_type) {
+#if SUPPORTED_SSD_TYPE(CONV)
+	case SSD_TYPE_CONV:
+		return conv_fit_namespace_size(size);
+#endif
+#if SUPPORTED_SSD_TYPE(ZNS)
+	case SSD_TYPE_ZNS:
+		return zns_fit_namespace_size(size);
+#endif
+	default:
+		return size;
+	}
+}
+
+/* lowest offset of the storage area with @size bytes not owned by any namespace */
+static bool __find_free_extent(uint64_t size, uint64_t *start)
+{
+	uint64_t offs = 0;
+	bool moved;
 	int i;
+
+	do {
+		moved = false;
+		for (i = 0; i < nvmev_vdev->nr_ns; i++) {
+			struct nvmev_ns *ns = &nvmev_vdev->ns[i];
+
+			if (ns->capacity && offs < ns->start + ns->capacity &&
+			    ns->start < offs + size) {
+				offs = ns->start + ns->capacity;
+				moved = true;
+			}
+		}
+	} while (moved);
+
+	if (offs + size > nvmev_vdev->config.storage_size)
+		return false;
+
+	*start = offs;
+	return true;
+}
+
+/*
+ * Carve @capacity bytes from the storage area and build an FTL of @ssd_type
+ * on them. The capacity is first rounded down to what the FTL can use. The
+ * namespace starts detached. Returns its index (nsid - 1), -ENOSPC if no nsid
+ * is free, -EINVAL if the capacity is too small for the FTL, or -ENOMEM if
+ * the storage area is too full or the FTL cannot be allocated.
+ */
+int nvmev_create_namespace(uint32_t ssd_type, uint64_t capacity)
+{
+	struct nvmev_ns *ns;
+	uint64_t start;
+	int i, ret;
+
+	for (i = 0; i < nvmev_vdev->nr_ns; i++) {
+		if (!nvmev_vdev->ns[i].capacity)
+			break;
+	}
+	if (i == nvmev_vdev->nr_ns)
+		return -ENOSPC;
+
+	capacity = __fit_namespace_size(ssd_type, capacity);
+	if (!capacity)
+		return -EINVAL;
+
+	if (!__find_free_extent(capacity, &start))
+		return -ENOMEM;
+
+	ns = &nvmev_vdev->ns[i];
+	ret = __init_namespace(ns, i, ssd_type, capacity, nvmev_vdev->storage_mapped + start);
+	if (ret) {
+		memset(ns, 0, sizeof(*ns));
+		return ret;
+	}
+	ns->start = start;
+	ns->capacity = capacity;
+	ns->ssd_type = ssd_type;
+	ns->attached = false;
+
+	NVMEV_INFO("ns %d: size %lld MiB at %lld MiB\n", i, BYTE_TO_MB(ns->size),
+		   BYTE_TO_MB(start));
+
+	return i;
+}
+
+/*
+ * The io workers must be done with the namespace: the copies of its commands
+ * and the releases of its write buffers touch the FTLs freed here.
+ */
+void nvmev_delete_namespace(struct nvmev_ns *ns)
+{
+	__remove_namespace(ns);
+	memset(ns, 0, sizeof(*ns));
+}
+
+static void NVMEV_NAMESPACE_INIT(struct nvmev_dev *nvmev_vdev)
+{
+	unsigned long long remaining_capacity = nvmev_vdev->config.storage_size;
+	const int nr_ns = NR_NAMESPACES;
+	int i, id;
 	unsigned long long size;
 
-	struct nvmev_ns *ns = kmalloc(sizeof(struct nvmev_ns) * nr_ns, GFP_KERNEL);
+	nvmev_vdev->ns = kcalloc(NR_MAX_NAMESPACES, sizeof(struct nvmev_ns), GFP_KERNEL);
+	nvmev_vdev->nr_ns = NR_MAX_NAMESPACES;
 
+	/* the namespaces of the profile, the host may create more later */
 	for (i = 0; i < nr_ns; i++) {
 		if (NS_CAPACITY(i) == 0)
 			size = remaining_capacity;
 		else
 			size = min(NS_CAPACITY(i), remaining_capacity);
 
-		if (NS_SSD_TYPE(i) == SSD_TYPE_NVM)
-			simple_init_namespace(&ns[i], i, size, ns_addr, disp_no);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_CONV)
-			conv_init_namespace(&ns[i], i, size, ns_addr, disp_no);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_ZNS)
-			zns_init_namespace(&ns[i], i, size, ns_addr, disp_no);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_KV)
-			kv_init_namespace(&ns[i], i, size, ns_addr, disp_no);
-		else
-			BUG_ON(1);
+		id = nvmev_create_namespace(NS_SSD_TYPE(i), size);
+		BUG_ON(id < 0);
+		nvmev_vdev->ns[id].attached = true;
 
 		remaining_capacity -= size;
-		ns_addr += size;
-		NVMEV_INFO("ns %d/%d: size %lld MiB\n", i, nr_ns, BYTE_TO_MB(ns[i].size));
 	}
 
-	nvmev_vdev->ns = ns;
-	nvmev_vdev->nr_ns = nr_ns;
 	nvmev_vdev->mdts = MDTS;
+	nvmev_vdev->vwc_enabled = WRITE_EARLY_COMPLETION;
 }
 
 static void NVMEV_NAMESPACE_FINAL(struct nvmev_dev *nvmev_vdev)
 {
-	struct nvmev_ns *ns = nvmev_vdev->ns;
-	const int nr_ns = NR_NAMESPACES; // XXX: allow for dynamic nvmev_vdev->nr_ns
 	int i;
 
-	for (i = 0; i < nr_ns; i++) {
-		if (NS_SSD_TYPE(i) == SSD_TYPE_NVM)
-			simple_remove_namespace(&ns[i]);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_CONV)
-			conv_remove_namespace(&ns[i]);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_ZNS)
-			zns_remove_namespace(&ns[i]);
-		else if (NS_SSD_TYPE(i) == SSD_TYPE_KV)
-			kv_remove_namespace(&ns[i]);
-		else
-			BUG_ON(1);
+	for (i = 0; i < nvmev_vdev->nr_ns; i++) {
+		if (nvmev_vdev->ns[i].capacity)
+			nvmev_delete_namespace(&nvmev_vdev->ns[i]);
 	}
 
-	kfree(ns);
+	kfree(nvmev_vdev->ns);
 	nvmev_vdev->ns = NULL;
 }
 
@@ -628,12 +886,15 @@ static int NVMeV_init(void)
 		goto ret_err;
 	}
 
+	nvmev_clock_init(nvmev_vdev->config.cpu_nr_dispatcher);
+
 	NVMEV_STORAGE_INIT(nvmev_vdev);
 
 	NVMEV_NAMESPACE_INIT(nvmev_vdev);
 
 	if (io_using_dma) {
-		if (ioat_dma_chan_set("dma7chan0") != 0) {
+		if (nvmev_dma_init(dma_backend, nvmev_vdev->config.nr_io_workers,
+				   nvmev_vdev->config.cpu_nr_io_workers) != 0) {
 			io_using_dma = false;
 			NVMEV_ERROR("Cannot use DMA engine, Fall back to memcpy\n");
 		}
@@ -675,7 +936,7 @@ static void NVMeV_exit(void)
 	NVMEV_STORAGE_FINAL(nvmev_vdev);
 
 	if (io_using_dma) {
-		ioat_dma_cleanup();
+		nvmev_dma_cleanup();
 	}
 
 	for (i = 0; i < nvmev_vdev->nr_sq; i++) {
@@ -118,7 +118,12 @@ struct nvme_id_ctrl {
 	__u8 apsta;
 	__le16 wctemp;
 	__le16 cctemp;
-	__u8 rsvd270[242];
+	__le16 mtfa;
+	__le32 hmpre;
+	__le32 hmmin;
+	__le64 tnvmcap[2];
+	__le64 unvmcap[2];
+	__u8 rsvd312[200];
 	__u8 sqes;
 	__u8 cqes;
 	__u8 rsvd514[2];
@@ -143,7 +148,11 @@ enum {
 	NVME_CTRL_ONCS_COMPARE = 1 << 0,
 	NVME_CTRL_ONCS_WRITE_UNCORRECTABLE = 1 << 1,
 	NVME_CTRL_ONCS_DSM = 1 << 2,
+	NVME_CTRL_ONCS_WRITE_ZEROES = 1 << 3,
+	NVME_CTRL_OACS_NS_MNGT = 1 << 3,
 	NVME_CTRL_VWC_PRESENT = 1 << 0,
+	NVME_CTRL_SGLS_BYTE_ALIGNED = 1 << 0,
+	NVME_CTRL_SGLS_BIT_BUCKET = 1 << 16,
 };
 
 struct nvme_lbaf {
@@ -355,6 +364,29 @@ struct nvme_common_command {
 	__le32 cdw10[6];
 };
 
+/* PSDT field of the command flags */
+enum {
+	NVME_CMD_SGL_METABUF = (1 << 6),
+	NVME_CMD_SGL_METASEG = (1 << 7),
+	NVME_CMD_SGL_ALL = NVME_CMD_SGL_METABUF | NVME_CMD_SGL_METASEG,
+};
+
+/* SGL descriptor types, in the upper nibble of type */
+enum {
+	NVME_SGL_FMT_DATA_DESC = 0x00,
+	NVME_SGL_FMT_BIT_BUCKET_DESC = 0x01,
+	NVME_SGL_FMT_SEG_DESC = 0x02,
+	NVME_SGL_FMT_LAST_SEG_DESC = 0x03,
+};
+
+/* overlays prp1 and prp2 when PSDT selects SGLs */
+struct nvme_sgl_desc {
+	__le64 addr;
+	__le32 length;
+	__u8 rsvd[3];
+	__u8 type;
+};
+
 struct nvme_rw_command {
 	__u8 opcode;
 	__u8 flags;
@@ -499,6 +531,7 @@ enum {
 	NVME_FEAT_WRITE_ATOMIC = 0x0a,
 	NVME_FEAT_ASYNC_EVENT = 0x0b,
 	NVME_FEAT_AUTO_PST = 0x0c,
+	NVME_FEAT_HOST_MEM_BUF = 0x0d,
 	NVME_FEAT_SW_PROGRESS = 0x80,
 	NVME_FEAT_HOST_ID = 0x81,
 	NVME_FEAT_RESV_MASK = 0x82,
@@ -542,7 +575,32 @@ struct nvme_features {
 	__le64 prp2;
 	__le32 fid;
 	__le32 dword11;
-	__u32 rsvd12[4];
+	__le32 dword12;
+	__le32 dword13;
+	__le32 dword14;
+	__le32 dword15;
+};
+
+#define NVME_NSID_ALL (0xffffffff)
+
+/* SEL field in dword10 of Namespace Management / Attachment */
+enum {
+	NVME_NS_MGMT_SEL_CREATE = 0,
+	NVME_NS_MGMT_SEL_DELETE = 1,
+	NVME_NS_ATTACH_SEL_CTRL_ATTACH = 0,
+	NVME_NS_ATTACH_SEL_CTRL_DEATTACH = 1,
+};
+
+/* data of Namespace Attachment */
+struct nvme_ctrl_list {
+	__le16 num;
+	__le16 identifier[2047];
+};
+
+/* dword11 of Set Features - Host Memory Buffer */
+enum {
+	NVME_HOST_MEM_ENABLE = (1 << 0),
+	NVME_HOST_MEM_RETURN = (1 << 1),
 };
 
 struct nvme_create_cq {
@@ -679,6 +737,11 @@ enum {
 	NVME_SC_FEATURE_NOT_CHANGEABLE = 0x10e,
 	NVME_SC_FEATURE_NOT_PER_NS = 0x10f,
 	NVME_SC_FW_NEEDS_RESET_SUBSYS = 0x110,
+	NVME_SC_NS_INSUFFICIENT_CAP = 0x115,
+	NVME_SC_NS_ID_UNAVAILABLE = 0x116,
+	NVME_SC_NS_ALREADY_ATTACHED = 0x118,
+	NVME_SC_NS_NOT_ATTACHED = 0x11a,
+	NVME_SC_CTRL_LIST_INVALID = 0x11c,
 	NVME_SC_BAD_ATTRIBUTES = 0x180,
 	NVME_SC_INVALID_PI = 0x181,
 	NVME_SC_READ_ONLY = 0x182,
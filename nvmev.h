@@ -5,6 +5,8 @@
 
 #include <linux/pci.h>
 #include <linux/msi.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
 #include <asm/apic.h>
 
 #include "nvme.h"
@@ -151,6 +153,9 @@ struct nvmev_config {
 	unsigned long storage_start; //byte
 	unsigned long storage_size; // byte
 
+	unsigned long cmb_start; // byte, in BAR0 right after the metadata
+	unsigned long cmb_size; // byte, 0 without a CMB
+
 	unsigned int cpu_nr_dispatcher;
 	unsigned int nr_io_workers;
 	unsigned int cpu_nr_io_workers[32];
@@ -185,6 +190,15 @@ struct nvmev_io_work {
 	bool is_copied;
 	bool is_completed;
 
+	/* chunked copy shared with other io workers */
+	unsigned int nr_chunks;
+	unsigned int next_chunk; /* protected by the owner's copy_lock */
+	atomic_t chunks_done;
+
+	/* asynchronous copy on the io worker's DMA channel */
+	bool is_dma_submitted;
+	atomic_t dma_pending;
+
 	unsigned int status;
 	unsigned int result0;
 	unsigned int result1;
@@ -206,6 +220,9 @@ struct nvmev_io_worker {
 
 	unsigned long long latest_nsecs;
 
+	spinlock_t copy_lock;
+	struct nvmev_io_work *copy_work; /* command other workers may help copy */
+
 	unsigned int id;
 	struct task_struct *task_struct;
 	char thread_name[32];
@@ -226,6 +243,7 @@ struct nvmev_dev {
 	struct task_struct *nvmev_dispatcher;
 
 	void *storage_mapped;
+	void *cmb_mapped;
 
 	struct nvmev_io_worker *io_workers;
 	unsigned int io_worker_turn;
@@ -240,7 +258,7 @@ struct nvmev_dev {
 	u32 *old_dbs;
 	u32 __iomem *dbs;
 
-	struct nvmev_ns *ns;
+	struct nvmev_ns *ns; /* NR_MAX_NAMESPACES slots, indexed by nsid - 1 */
 	unsigned int nr_ns;
 	unsigned int nr_sq;
 	unsigned int nr_cq;
@@ -251,6 +269,13 @@ struct nvmev_dev {
 
 	unsigned int mdts;
 
+	/* host memory buffer, in 4KiB units */
+	unsigned int hmb_pref; /* what the FTLs want, also the minimum */
+	unsigned int hmb_size; /* what the host gave */
+	bool hmb_enabled;
+
+	bool vwc_enabled; /* writes may complete from the volatile write buffer */
+
 	struct proc_dir_entry *proc_root;
 	struct proc_dir_entry *proc_read_times;
 	struct proc_dir_entry *proc_write_times;
@@ -258,11 +283,33 @@ struct nvmev_dev {
 	struct proc_dir_entry *proc_stat;
 	struct proc_dir_entry *proc_debug;
 	struct proc_dir_entry *proc_waf;
+	struct proc_dir_entry *proc_read_retry;
+	struct proc_dir_entry *proc_read_cache;
+	struct proc_dir_entry *proc_l2p_cache;
 
 	unsigned long long *io_unit_stat;
 	
 	unsigned long long user_write;
 	unsigned long long device_write;
+
+	/* updated from the FTLs of every namespace, read and reset through procfs */
+	atomic64_t nr_nand_reads;
+	atomic64_t nr_read_retries;
+	atomic64_t nr_soft_decodes;
+
+	atomic64_t rc_hits; /* pages served from the read cache */
+	atomic64_t rc_misses; /* pages read from NAND */
+	atomic64_t ra_issued; /* flash pages read ahead */
+	atomic64_t ra_useful; /* read-ahead flash pages hit later */
+
+	atomic64_t l2p_hits; /* mapping lookups served on the device */
+	atomic64_t l2p_misses; /* mapping segments fetched from the HMB */
+	atomic64_t l2p_writebacks; /* dirty segments written to the HMB */
+	atomic64_t cmt_hits; /* mapping lookups served from the CMT */
+	atomic64_t cmt_misses; /* translation pages loaded into the CMT */
+	atomic64_t cmt_writebacks; /* translation pages programmed */
+
+	unsigned long long nsecs_batch; /* device time of the batch being dispatched */
 };
 
 struct nvmev_request {
@@ -276,12 +323,20 @@ struct nvmev_result {
 	uint64_t nsecs_target;
 };
 
+#define NR_MAX_NAMESPACES (16)
+
 struct nvmev_ns {
 	uint32_t id;
 	uint32_t csi;
 	uint64_t size;
 	void *mapped;
 
+	/* storage area given to the FTL, 0 bytes if the nsid is not allocated */
+	uint64_t start;
+	uint64_t capacity;
+	uint32_t ssd_type;
+	bool attached;
+
 	/*conv ftl or zns or kv*/
 	uint32_t nr_parts; // partitions
 	void *ftls; // ftl instances. one ftl per partition
@@ -297,11 +352,50 @@ struct nvmev_ns {
 				       uint32_t *status);
 };
 
+// Device clock
+DECLARE_PER_CPU(long long, nvmev_clock_offs);
+void nvmev_clock_init(int cpu_base);
+
+/*
+ * Device time shared by the dispatcher and the io workers: the local
+ * sched_clock plus a per-cpu offset to the dispatcher's clock, so that no
+ * cross-cpu clock read is needed on the I/O path.
+ */
+static inline unsigned long long nvmev_clock(void)
+{
+	unsigned long long now;
+
+	/* both reads must come from the same cpu */
+	preempt_disable();
+	now = local_clock() + __this_cpu_read(nvmev_clock_offs);
+	preempt_enable();
+
+	return now;
+}
+
 // VDEV Init, Final Function
 extern struct nvmev_dev *nvmev_vdev;
 struct nvmev_dev *VDEV_INIT(void);
 void VDEV_FINALIZE(struct nvmev_dev *nvmev_vdev);
 
+// Namespace management
+int nvmev_create_namespace(uint32_t ssd_type, uint64_t capacity);
+void nvmev_delete_namespace(struct nvmev_ns *ns);
+
+/*
+ * The CMB is carved from the reserved region, which is not in the direct map.
+ * Returns NULL if paddr is host memory.
+ */
+static inline void *nvmev_cmb_vaddr(u64 paddr)
+{
+	struct nvmev_config *cfg = &nvmev_vdev->config;
+
+	if (paddr - cfg->cmb_start >= cfg->cmb_size)
+		return NULL;
+
+	return nvmev_vdev->cmb_mapped + (paddr - cfg->cmb_start);
+}
+
 // OPS_PCI
 bool nvmev_proc_bars(void);
 bool NVMEV_PCI_INIT(struct nvmev_dev *dev);
@@ -315,6 +409,7 @@ void nvmev_proc_admin_cq(int new_db, int old_db);
 struct buffer;
 void schedule_internal_operation(int sqid, unsigned long long nsecs_target,
 				struct buffer *write_buffer);
+void nvmev_drain_io_workers(void);
 void NVMEV_IO_WORKER_INIT(struct nvmev_dev *nvmev_vdev);
 void NVMEV_IO_WORKER_FINAL(struct nvmev_dev *nvmev_vdev);
 int nvmev_proc_io_sq(int qid, int new_db, int old_db);
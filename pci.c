@@ -262,6 +262,15 @@ out:
 	return true;
 }
 
+/* BAR0 holds the registers, doorbells and MSI-X table, then the CMB aligned to its size */
+static inline u32 __bar0_size(void)
+{
+	if (nvmev_vdev->config.cmb_size)
+		return nvmev_vdev->config.cmb_size * 2;
+
+	return KB(16);
+}
+
 static int nvmev_pci_read(struct pci_bus *bus, unsigned int devfn, int where, int size, u32 *val)
 {
 	if (devfn != 0)
@@ -299,7 +308,7 @@ static int nvmev_pci_write(struct pci_bus *bus, unsigned int devfn, int where, i
 		} else if (target == PCI_BIST) {
 			mask = PCI_BIST_START;
 		} else if (target == PCI_BASE_ADDRESS_0) {
-			mask = 0xFFFFC000;
+			mask = ~(__bar0_size() - 1);
 		} else if (target == PCI_INTERRUPT_LINE) {
 			mask = 0xFF;
 		} else {
@@ -383,6 +392,24 @@ static void __init_nvme_ctrl_regs(struct pci_dev *dev)
 			.mnr = 0,
 		},
 	};
+
+	if (nvmev_vdev->config.cmb_size) {
+		unsigned long cmb_mb = BYTE_TO_MB(nvmev_vdev->config.cmb_size);
+
+		nvmev_vdev->cmb_mapped = memremap(nvmev_vdev->config.cmb_start,
+						  nvmev_vdev->config.cmb_size, MEMREMAP_WB);
+		BUG_ON(!nvmev_vdev->cmb_mapped);
+
+		/* SQs, PRP/SGL lists and data may live in the CMB, in 1MiB units */
+		bar->cmbloc.bir = 0;
+		bar->cmbloc.ofst = cmb_mb;
+		bar->cmbsz.sqs = 1;
+		bar->cmbsz.lists = 1;
+		bar->cmbsz.rds = 1;
+		bar->cmbsz.wds = 1;
+		bar->cmbsz.szu = 2;
+		bar->cmbsz.sz = cmb_mb;
+	}
 }
 
 static struct pci_bus *__create_pci_bus(void)
@@ -455,6 +482,9 @@ void VDEV_FINALIZE(struct nvmev_dev *nvmev_vdev)
 	if (nvmev_vdev->msix_table)
 		memunmap(nvmev_vdev->msix_table);
 
+	if (nvmev_vdev->cmb_mapped)
+		memunmap(nvmev_vdev->cmb_mapped);
+
 	if (nvmev_vdev->bar)
 		memunmap(nvmev_vdev->bar);
 
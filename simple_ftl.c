@@ -5,10 +5,6 @@
 
 #include "simple_ftl.h"
 
-static inline unsigned long long __get_wallclock(void)
-{
-	return cpu_clock(nvmev_vdev->config.cpu_nr_dispatcher);
-}
 
 static size_t __cmd_io_size(struct nvme_rw_command *cmd)
 {
@@ -86,11 +82,15 @@ bool simple_proc_nvme_io_cmd(struct nvmev_ns *ns, struct nvmev_request *req,
 	case nvme_cmd_read:
 		ret->nsecs_target = __schedule_io_units(
 			cmd->common.opcode, cmd->rw.slba,
-			__cmd_io_size((struct nvme_rw_command *)cmd), __get_wallclock());
+			__cmd_io_size((struct nvme_rw_command *)cmd), req->nsecs_start);
 		break;
 	case nvme_cmd_flush:
 		ret->nsecs_target = __schedule_flush(req);
 		break;
+	case nvme_cmd_write_zeroes:
+		/* No data transfer; only the command overhead is charged */
+		ret->nsecs_target = req->nsecs_start + nvmev_vdev->config.write_delay;
+		break;
 	default:
 		NVMEV_ERROR("%s: command not implemented: %s (0x%x)\n", __func__,
 			    nvme_opcode_string(cmd->common.opcode), cmd->common.opcode);
@@ -1,5 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0-only
+#include <linux/bitops.h>
 #include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
 #include <linux/sched/clock.h>
 
 #include "nvmev.h"
@@ -10,9 +13,103 @@
 #define ROUNDDOWN(x, y) ((x) - ((x) % (y)))
 #define ROUNDUP(x, y) (((x) + (y) - 1) / (y) * (y))
 
+struct ssd_profile ssd_profile = {
+	.nr_parts = SSD_PARTITIONS,
+	.nchs = NAND_CHANNELS,
+	.luns_per_ch = LUNS_PER_NAND_CH,
+	.pgsz = LOGICAL_PAGE_SIZE,
+	.flashpgsz = FLASH_PAGE_SIZE,
+	.oneshotpgsz = ONESHOT_PAGE_SIZE,
+	.wb_size = GLOBAL_WB_SIZE,
+	.pg_rd_lat = 0,
+	.pg_wr_lat = NAND_PROG_LATENCY,
+	.blk_er_lat = NAND_ERASE_LATENCY,
+	.preage_pe = NAND_PREAGE_PE_CYCLES,
+	.preage_days = NAND_PREAGE_DAYS,
+};
+
+module_param_named(ssd_partitions, ssd_profile.nr_parts, uint, 0444);
+MODULE_PARM_DESC(ssd_partitions, "FTL instances per namespace, dividing the NAND channels");
+module_param_named(nand_channels, ssd_profile.nchs, uint, 0444);
+MODULE_PARM_DESC(nand_channels, "NAND channels");
+module_param_named(luns_per_ch, ssd_profile.luns_per_ch, uint, 0444);
+MODULE_PARM_DESC(luns_per_ch, "LUNs per NAND channel");
+module_param_named(mapping_unit, ssd_profile.pgsz, uint, 0444);
+MODULE_PARM_DESC(mapping_unit, "FTL mapping unit in bytes (4096, 16384, ...)");
+module_param_named(flash_page_size, ssd_profile.flashpgsz, uint, 0444);
+MODULE_PARM_DESC(flash_page_size, "Flash page size in bytes");
+module_param_named(oneshot_page_size, ssd_profile.oneshotpgsz, uint, 0444);
+MODULE_PARM_DESC(oneshot_page_size, "Bytes programmed at once, a multiple of flash_page_size");
+module_param_named(write_buffer_size, ssd_profile.wb_size, ulong, 0444);
+MODULE_PARM_DESC(write_buffer_size, "Write buffer in bytes, split among the partitions");
+module_param_named(nand_read_lat, ssd_profile.pg_rd_lat, uint, 0444);
+MODULE_PARM_DESC(nand_read_lat, "NAND page read latency in ns, 0 keeps the per-cell-type latencies");
+module_param_named(nand_prog_lat, ssd_profile.pg_wr_lat, uint, 0444);
+MODULE_PARM_DESC(nand_prog_lat, "NAND program latency in ns");
+module_param_named(nand_erase_lat, ssd_profile.blk_er_lat, uint, 0444);
+MODULE_PARM_DESC(nand_erase_lat, "NAND block erase latency in ns");
+module_param_named(nand_preage_pe, ssd_profile.preage_pe, uint, 0444);
+MODULE_PARM_DESC(nand_preage_pe, "P/E cycles every block starts with (reliability model)");
+module_param_named(nand_preage_days, ssd_profile.preage_days, uint, 0444);
+MODULE_PARM_DESC(nand_preage_days, "Days of retention the data starts with (reliability model)");
+
+int ssd_check_profile(void)
+{
+	struct ssd_profile *p = &ssd_profile;
+
+	if (p->nr_parts == 0 || p->nr_parts > SSD_MAX_PARTITIONS) {
+		NVMEV_ERROR("[ssd_partitions] should be between 1 and %d\n", SSD_MAX_PARTITIONS);
+		return -EINVAL;
+	}
+
+	if (p->nchs == 0 || p->nchs % p->nr_parts) {
+		NVMEV_ERROR("[nand_channels] should be a multiple of ssd_partitions\n");
+		return -EINVAL;
+	}
+
+	if (p->luns_per_ch == 0) {
+		NVMEV_ERROR("[luns_per_ch] should be specified\n");
+		return -EINVAL;
+	}
+
+	/* the write buffer tracks the sectors of a page in a 64-bit bitmap */
+	if (!is_power_of_2(p->pgsz) || p->pgsz < KB(4) || p->pgsz / LBA_SIZE > 64) {
+		NVMEV_ERROR("[mapping_unit] should be a power of 2 between 4 KiB and %d KiB\n",
+			    64 * LBA_SIZE / 1024);
+		return -EINVAL;
+	}
+
+	if (p->flashpgsz == 0 || p->flashpgsz % p->pgsz) {
+		NVMEV_ERROR("[flash_page_size] should be a multiple of mapping_unit\n");
+		return -EINVAL;
+	}
+
+	if (p->oneshotpgsz == 0 || p->oneshotpgsz % p->flashpgsz) {
+		NVMEV_ERROR("[oneshot_page_size] should be a multiple of flash_page_size\n");
+		return -EINVAL;
+	}
+
+#if SUPPORTED_SSD_TYPE(ZNS)
+	/* zones are laid out over the dies of the build */
+	if (p->nr_parts != SSD_PARTITIONS || p->nchs != NAND_CHANNELS ||
+	    p->luns_per_ch != LUNS_PER_NAND_CH || p->pgsz != LOGICAL_PAGE_SIZE ||
+	    p->flashpgsz != FLASH_PAGE_SIZE || p->oneshotpgsz != ONESHOT_PAGE_SIZE) {
+		NVMEV_ERROR("ZNS geometry cannot be changed at load time\n");
+		return -EINVAL;
+	}
+#else
+	if (p->wb_size / p->nr_parts < p->flashpgsz * 2) {
+		NVMEV_ERROR("[write_buffer_size] should hold two flash pages per partition\n");
+		return -EINVAL;
+	}
+#endif
+
+	return 0;
+}
+
 static inline uint64_t __get_ioclock(struct ssd *ssd)
 {
-	return cpu_clock(ssd->cpu_nr_dispatcher);
+	return nvmev_vdev->nsecs_batch;
 }
 
 void buffer_init(struct buffer *buf, size_t size, struct ssdparams *spp)
@@ -28,17 +125,22 @@ void buffer_init(struct buffer *buf, size_t size, struct ssdparams *spp)
 	buf->flush_threshold = buf->ppg_per_buf / 2;
 	INIT_LIST_HEAD(&buf->free_ppgs);
 	INIT_LIST_HEAD(&buf->used_ppgs);
-	
+
+	NVMEV_ASSERT(buf->sec_per_pg <= 64);
+
+	buf->ppgs = kcalloc(buf->ppg_per_buf, sizeof(struct buffer_ppg), GFP_KERNEL);
+	buf->pages = kcalloc(buf->ppg_per_buf * buf->pg_per_ppg, sizeof(struct buffer_page),
+			     GFP_KERNEL);
+
 	for (int i = 0; i < buf->ppg_per_buf; i++) {
-		struct buffer_ppg* block = 
-			(struct buffer_ppg*)kmalloc(sizeof(struct buffer_ppg), GFP_KERNEL);
+		struct buffer_ppg *block = &buf->ppgs[i];
 		block->valid = true;
 		block->complete_time = 0;
-		block->pages = (struct buffer_page*)kmalloc(sizeof(struct buffer_page) * buf->pg_per_ppg, GFP_KERNEL);
+		block->pages = &buf->pages[i * buf->pg_per_ppg];
 		for (int j = 0; j < buf->pg_per_ppg; j++) {
 			block->pages[j].lpn = INVALID_LPN;
 			block->pages[j].free_secs = buf->sec_per_pg;
-			block->pages[j].sectors = kmalloc(sizeof(bool) * buf->sec_per_pg, GFP_KERNEL);
+			block->pages[j].sectors = 0;
 		}
 		list_add_tail(&block->list, &buf->free_ppgs);
 	}
@@ -97,12 +199,13 @@ static void __buffer_fill_page(struct buffer *buf, uint64_t lpn, uint64_t size,
 
 	page->lpn = lpn;
 
-	for (size_t i = 0; i < size / LBA_SIZE; i++) {
-		size_t idx = i + offset;
-		if (!page->sectors[idx]) {
-			page->free_secs--;
-			page->sectors[idx] = true;
-		}
+	if (size == buf->pg_size) {
+		/* whole logical page, always the case with 4KiB LBAs */
+		page->sectors = GENMASK_ULL(buf->sec_per_pg - 1, 0);
+		page->free_secs = 0;
+	} else {
+		page->sectors |= GENMASK_ULL(offset + size / LBA_SIZE - 1, offset);
+		page->free_secs = buf->sec_per_pg - hweight64(page->sectors);
 	}
 
 	spin_unlock(&buf->lock);
@@ -115,12 +218,12 @@ bool buffer_allocate(struct nvmev_ns *ns, uint64_t start_lpn, uint64_t end_lpn,
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct buffer *buf = NULL;
 	struct buffer_page *page = NULL;
-	uint32_t nr_parts = SSD_PARTITIONS;
+	uint32_t nr_parts = ssd_profile.nr_parts;
 	uint64_t pgsz = spp->pgsz;
 	uint64_t s_lpn = start_lpn;
 	uint64_t e_lpn = end_lpn;
 	uint64_t start_size = min((spp->secs_per_pg - start_offset) * LBA_SIZE, size);
-	size_t required_pgs[SSD_PARTITIONS] = {0, };
+	size_t required_pgs[SSD_MAX_PARTITIONS] = {0, };
 	size_t ftl_idx;
 
 	for (size_t i = 0; (i < nr_parts) && (s_lpn <= e_lpn); i++, s_lpn += spp->pgs_per_flashpg) {
@@ -198,9 +301,7 @@ bool buffer_release(struct buffer *buf, uint64_t complete_time)
 			for (size_t i = 0; i < block->pg_idx; i++) {
 				block->pages[i].lpn = INVALID_LPN;
 				block->pages[i].free_secs = buf->sec_per_pg;
-				for (size_t j = 0; j < buf->sec_per_pg; j++) {
-					block->pages[i].sectors[j] = false;
-				}
+				block->pages[i].sectors = 0;
 			}
 			buf->free_pgs_cnt += block->pg_idx;
 			block->pg_idx = 0;
@@ -228,9 +329,7 @@ void buffer_refill(struct buffer *buf)
 		for (size_t i = 0; i < block->pg_idx; i++) {
 			block->pages[i].lpn = INVALID_LPN;
 			block->pages[i].free_secs = buf->sec_per_pg;
-			for (size_t j = 0; j < buf->sec_per_pg; j++) {
-				block->pages[i].sectors[j] = false;
-			}
+			block->pages[i].sectors = 0;
 		}
 		buf->free_pgs_cnt += block->pg_idx;
 		block->pg_idx = 0;
@@ -256,6 +355,29 @@ struct buffer_page *buffer_search(struct buffer *buf, uint64_t lpn)
 	return NULL;
 }
 
+/* drop the buffered pages of [start_lpn, end_lpn], deallocated before being flushed */
+void buffer_discard(struct buffer *buf, uint64_t start_lpn, uint64_t end_lpn)
+{
+	struct buffer_ppg *ppg;
+
+	while (!spin_trylock(&buf->lock))
+		;
+
+	list_for_each_entry(ppg, &buf->used_ppgs, list) {
+		if (!ppg->valid)
+			continue;
+
+		for (int i = 0; i < ppg->pg_idx; i++) {
+			struct buffer_page *page = &ppg->pages[i];
+
+			if (page->lpn >= start_lpn && page->lpn <= end_lpn)
+				page->lpn = INVALID_LPN;
+		}
+	}
+
+	spin_unlock(&buf->lock);
+}
+
 static void check_params(struct ssdparams *spp)
 {
 	/*
@@ -270,14 +392,16 @@ static void check_params(struct ssdparams *spp)
 void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 {
 	uint64_t blk_size, total_size;
+	uint32_t flashpgsz, oneshotpgsz;
+	uint32_t i;
 
 	spp->secsz = LBA_SIZE;
-	spp->secs_per_pg = LOGICAL_PAGE_SIZE / LBA_SIZE; // pg == 4KB
-	spp->pgsz = LOGICAL_PAGE_SIZE;
+	spp->secs_per_pg = ssd_profile.pgsz / LBA_SIZE; // pg == 4KB
+	spp->pgsz = ssd_profile.pgsz;
 
-	spp->nchs = NAND_CHANNELS;
+	spp->nchs = ssd_profile.nchs;
 	spp->pls_per_lun = PLNS_PER_LUN;
-	spp->luns_per_ch = LUNS_PER_NAND_CH;
+	spp->luns_per_ch = ssd_profile.luns_per_ch;
 	spp->cell_mode = CELL_MODE;
 
 	/* partitioning SSD by dividing channel*/
@@ -297,14 +421,16 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 								  spp->luns_per_ch * spp->nchs);
 	}
 
-	NVMEV_ASSERT((ONESHOT_PAGE_SIZE % spp->pgsz) == 0 && (FLASH_PAGE_SIZE % spp->pgsz) == 0);
-	NVMEV_ASSERT((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
+	oneshotpgsz = ssd_profile.oneshotpgsz;
+	flashpgsz = ssd_profile.flashpgsz;
+	NVMEV_ASSERT((oneshotpgsz % spp->pgsz) == 0 && (flashpgsz % spp->pgsz) == 0);
+	NVMEV_ASSERT((oneshotpgsz % flashpgsz) == 0);
 
-	spp->pgs_per_oneshotpg = ONESHOT_PAGE_SIZE / (spp->pgsz);
-	spp->oneshotpgs_per_blk = DIV_ROUND_UP(blk_size, ONESHOT_PAGE_SIZE);
+	spp->pgs_per_oneshotpg = oneshotpgsz / (spp->pgsz);
+	spp->oneshotpgs_per_blk = DIV_ROUND_UP(blk_size, oneshotpgsz);
 
-	spp->pgs_per_flashpg = FLASH_PAGE_SIZE / (spp->pgsz);
-	spp->flashpgs_per_blk = (ONESHOT_PAGE_SIZE / FLASH_PAGE_SIZE) * spp->oneshotpgs_per_blk;
+	spp->pgs_per_flashpg = flashpgsz / (spp->pgsz);
+	spp->flashpgs_per_blk = (oneshotpgsz / flashpgsz) * spp->oneshotpgs_per_blk;
 
 	spp->pgs_per_blk = spp->pgs_per_oneshotpg * spp->oneshotpgs_per_blk;
 
@@ -316,8 +442,32 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 	spp->pg_rd_lat[CELL_TYPE_LSB] = NAND_READ_LATENCY_LSB;
 	spp->pg_rd_lat[CELL_TYPE_MSB] = NAND_READ_LATENCY_MSB;
 	spp->pg_rd_lat[CELL_TYPE_CSB] = NAND_READ_LATENCY_CSB;
-	spp->pg_wr_lat = NAND_PROG_LATENCY;
-	spp->blk_er_lat = NAND_ERASE_LATENCY;
+	if (ssd_profile.pg_rd_lat) {
+		for (i = 0; i < MAX_CELL_TYPES; i++) {
+			spp->pg_4kb_rd_lat[i] = ssd_profile.pg_rd_lat;
+			spp->pg_rd_lat[i] = ssd_profile.pg_rd_lat;
+		}
+	}
+	spp->pg_wr_lat = ssd_profile.pg_wr_lat;
+	spp->blk_er_lat = ssd_profile.blk_er_lat;
+	spp->slc_pg_rd_lat = NAND_SLC_READ_LATENCY;
+	spp->slc_pg_wr_lat = NAND_SLC_PROG_LATENCY;
+	spp->pg_sus_lat = NAND_SUSPEND_LATENCY;
+	spp->pg_res_lat = NAND_RESUME_LATENCY;
+	spp->max_suspends = MAX_NAND_SUSPENDS;
+	spp->sched_policy = NAND_SCHED_POLICY;
+
+	spp->enable_reliability = NAND_RELIABILITY;
+	spp->endurance = NAND_ENDURANCE;
+	spp->retention = NAND_RETENTION_SECS * NS_PER_SEC(1);
+	spp->slc_endurance = NAND_SLC_ENDURANCE;
+	spp->slc_retention = NAND_SLC_RETENTION_SECS * NS_PER_SEC(1);
+	spp->preage_pe = ssd_profile.preage_pe;
+	spp->preage_ret = ssd_profile.preage_days * 86400ULL * NS_PER_SEC(1);
+	spp->rr_thres = NAND_RR_THRES;
+	spp->rr_step = NAND_RR_STEP;
+	spp->max_rr = NAND_MAX_READ_RETRY;
+	spp->soft_dec_lat = NAND_SOFT_DECODE_LATENCY;
 	spp->max_ch_xfer_size = MAX_CH_XFER_SIZE;
 
 	spp->fw_4kb_rd_lat = FW_4KB_READ_LATENCY;
@@ -329,7 +479,7 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 	spp->ch_bandwidth = NAND_CHANNEL_BANDWIDTH;
 	spp->pcie_bandwidth = PCIE_BANDWIDTH;
 
-	spp->write_buffer_size = GLOBAL_WB_SIZE / SSD_PARTITIONS;
+	spp->write_buffer_size = ssd_profile.wb_size / nparts;
 	spp->write_early_completion = WRITE_EARLY_COMPLETION;
 
 	/* calculated values */
@@ -353,12 +503,14 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 
 	spp->tt_luns = spp->luns_per_ch * spp->nchs;
 
+	/* a block in SLC mode keeps one bit per cell */
+	spp->slc_pgs_per_blk = ROUNDDOWN(spp->pgs_per_blk / max(CELL_MODE, 1), spp->pgs_per_oneshotpg);
+
 	/* line is special, put it at the end */
-	spp->blks_per_line = spp->tt_luns; /* TODO: to fix under multiplanes */
+	spp->blks_per_line = spp->tt_pls; /* a line spans the same block of every plane */
 	spp->pgs_per_line = spp->blks_per_line * spp->pgs_per_blk;
 	spp->secs_per_line = spp->pgs_per_line * spp->secs_per_pg;
-	spp->tt_lines = spp->blks_per_lun;
-	/* TODO: to fix under multiplanes */ // lun size is super-block(line) size
+	spp->tt_lines = spp->blks_per_pl;
 
 	check_params(spp);
 
@@ -366,8 +518,8 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 		     spp->secsz * spp->secs_per_pg;
 	blk_size = spp->pgs_per_blk * spp->secsz * spp->secs_per_pg;
 	NVMEV_INFO(
-		"Total Capacity(GiB,MiB)=%llu,%llu chs=%u luns=%lu lines=%lu blk-size(MiB,KiB)=%u,%u line-size(MiB,KiB)=%lu,%lu",
-		BYTE_TO_GB(total_size), BYTE_TO_MB(total_size), spp->nchs, spp->tt_luns,
+		"Total Capacity(GiB,MiB)=%llu,%llu chs=%u luns=%lu pls=%lu lines=%lu blk-size(MiB,KiB)=%u,%u line-size(MiB,KiB)=%lu,%lu",
+		BYTE_TO_GB(total_size), BYTE_TO_MB(total_size), spp->nchs, spp->tt_luns, spp->tt_pls,
 		spp->tt_lines, BYTE_TO_MB(spp->pgs_per_blk * spp->pgsz),
 		BYTE_TO_KB(spp->pgs_per_blk * spp->pgsz), BYTE_TO_MB(spp->pgs_per_line * spp->pgsz),
 		BYTE_TO_KB(spp->pgs_per_line * spp->pgsz));
@@ -399,8 +551,10 @@ static void ssd_init_nand_blk(struct nand_block *blk, struct ssdparams *spp)
 	}
 	blk->ipc = 0;
 	blk->vpc = 0;
-	blk->erase_cnt = 0;
+	blk->erase_cnt = spp->preage_pe;
 	blk->wp = 0;
+	blk->prog_time = 0;
+	blk->slc = false;
 }
 
 static void ssd_remove_nand_blk(struct nand_block *blk)
@@ -421,6 +575,13 @@ static void ssd_init_nand_plane(struct nand_plane *pl, struct ssdparams *spp)
 	for (i = 0; i < pl->nblks; i++) {
 		ssd_init_nand_blk(&pl->blk[i], spp);
 	}
+	pl->next_pln_avail_time = 0;
+	pl->susp_op_stime = 0;
+	pl->susp_op_etime = 0;
+	pl->susp_rd_etime = 0;
+	pl->nr_suspends = 0;
+	pl->nr_resv = 0;
+	pl->resv_floor = 0;
 }
 
 static void ssd_remove_nand_plane(struct nand_plane *pl)
@@ -474,21 +635,9 @@ static void ssd_init_ch(struct ssd_channel *ch, struct ssdparams *spp)
 static void ssd_remove_buffer(struct ssd *ssd)
 {
 	struct buffer *buf = &ssd->write_buffer;
-	struct buffer_ppg *block, *tmp;
-	list_for_each_entry_safe(block, tmp, &buf->free_ppgs, list) {
-		for (int i = 0; i < buf->pg_per_ppg; i++) {
-			kfree(block->pages[i].sectors);
-		}
-		kfree(block->pages);
-		kfree(block);
-	}
-	list_for_each_entry_safe(block, tmp, &buf->used_ppgs, list) {
-		for (int i = 0; i < buf->pg_per_ppg; i++) {
-			kfree(block->pages[i].sectors);
-		}
-		kfree(block->pages);
-		kfree(block);
-	}
+
+	kfree(buf->pages);
+	kfree(buf->ppgs);
 }
 
 static void ssd_remove_ch(struct ssd_channel *ch)
@@ -581,6 +730,176 @@ uint64_t ssd_advance_write_buffer(struct ssd *ssd, uint64_t request_time, uint64
 	return nsecs_latest;
 }
 
+/*
+ * A read may suspend the program/erase that is running on the plane at stime,
+ * i.e. in its NAND phase rather than still queued or transferring data, as
+ * long as nothing else has been reserved behind it.
+ */
+static inline bool __ssd_suspendable(struct ssdparams *spp, struct nand_plane *pl,
+				     uint64_t stime)
+{
+	return spp->max_suspends > 0 && stime >= pl->susp_op_stime && stime < pl->susp_op_etime &&
+	       pl->next_pln_avail_time == pl->susp_op_etime;
+}
+
+static inline void __ssd_start_suspendable(struct nand_plane *pl, uint64_t stime, uint64_t etime)
+{
+	pl->susp_op_stime = stime;
+	pl->susp_op_etime = etime;
+	pl->susp_rd_etime = 0;
+	pl->nr_suspends = 0;
+}
+
+/*
+ * Per-plane reservation timeline. Programs and erases are always appended,
+ * while under NAND_SCHED_READ_FIRST a read is placed into the first idle gap
+ * that can hold it, even if that gap lies before already reserved operations.
+ */
+static void __ssd_resv_add(struct ssdparams *spp, struct nand_plane *pl, uint64_t stime,
+			   uint64_t etime)
+{
+	int i;
+
+	if (!(spp->sched_policy & NAND_SCHED_READ_FIRST))
+		return;
+
+	if (pl->nr_resv == NAND_RESV_SLOTS) {
+		/* drop the oldest reservation */
+		pl->resv_floor = max(pl->resv_floor, pl->resv[0].etime);
+		memmove(&pl->resv[0], &pl->resv[1], sizeof(struct nand_resv) * (NAND_RESV_SLOTS - 1));
+		pl->nr_resv--;
+	}
+
+	for (i = pl->nr_resv; i > 0 && pl->resv[i - 1].stime > stime; i--)
+		pl->resv[i] = pl->resv[i - 1];
+
+	pl->resv[i].stime = stime;
+	pl->resv[i].etime = etime;
+	pl->nr_resv++;
+}
+
+static void __ssd_resv_extend(struct nand_plane *pl, uint64_t etime, uint64_t new_etime)
+{
+	int i;
+
+	for (i = pl->nr_resv - 1; i >= 0; i--) {
+		if (pl->resv[i].etime == etime) {
+			pl->resv[i].etime = new_etime;
+			return;
+		}
+	}
+}
+
+static uint64_t __ssd_resv_find_gap(struct nand_plane *pl, uint64_t stime, uint64_t duration)
+{
+	uint64_t t = max(stime, pl->resv_floor);
+	int i;
+
+	for (i = 0; i < pl->nr_resv; i++) {
+		if (pl->resv[i].etime <= t)
+			continue;
+		if (pl->resv[i].stime >= t + duration)
+			return t;
+		t = pl->resv[i].etime;
+	}
+
+	return max(t, pl->next_pln_avail_time);
+}
+
+/*
+ * A read placed into a gap at stime ended at etime, later than planned because
+ * the channel was busy. Push the reservations it overlaps, and everything
+ * behind them, out by the overrun.
+ */
+static void __ssd_resv_shift(struct nand_plane *pl, uint64_t stime, uint64_t etime)
+{
+	uint64_t delay = 0;
+	int i;
+
+	for (i = 0; i < pl->nr_resv; i++) {
+		if (pl->resv[i].stime <= stime)
+			continue;
+		if (!delay) {
+			if (pl->resv[i].stime >= etime)
+				return;
+			delay = etime - pl->resv[i].stime;
+		}
+		pl->resv[i].stime += delay;
+		pl->resv[i].etime += delay;
+	}
+
+	if (!delay)
+		return;
+
+	if (pl->susp_op_etime == pl->next_pln_avail_time) {
+		pl->susp_op_stime += delay;
+		pl->susp_op_etime += delay;
+	}
+	pl->next_pln_avail_time += delay;
+}
+
+/*
+ * Extra sensing time of a read from blk. Wear and retention are expressed in
+ * permille of the endurance and retention rated for the block's cell mode;
+ * past rr_thres every rr_step costs one more read retry (a re-sense with
+ * shifted read levels), and after max_rr retries the page is soft decoded.
+ */
+static uint64_t __ssd_read_retry_lat(struct ssdparams *spp, struct nand_block *blk,
+				     uint64_t sense_lat, uint64_t now)
+{
+	uint64_t age = spp->preage_ret + ((now > blk->prog_time) ? now - blk->prog_time : 0);
+	int endurance = blk->slc ? spp->slc_endurance : spp->endurance;
+	uint64_t retention = blk->slc ? spp->slc_retention : spp->retention;
+	uint64_t stress, retries;
+
+	if (!spp->enable_reliability)
+		return 0;
+
+	atomic64_inc(&nvmev_vdev->nr_nand_reads);
+
+	stress = (uint64_t)blk->erase_cnt * 1000 / endurance + age / (retention / 1000);
+	if (stress < spp->rr_thres)
+		return 0;
+
+	retries = (stress - spp->rr_thres) / spp->rr_step + 1;
+	if (retries > spp->max_rr) {
+		atomic64_add(spp->max_rr, &nvmev_vdev->nr_read_retries);
+		atomic64_inc(&nvmev_vdev->nr_soft_decodes);
+		return spp->max_rr * sense_lat + spp->soft_dec_lat;
+	}
+
+	atomic64_add(retries, &nvmev_vdev->nr_read_retries);
+	return retries * sense_lat;
+}
+
+/* expected plane occupancy of a read: sensing plus an uncontended channel transfer */
+static inline uint64_t __ssd_read_slot(struct ssd_channel *ch, uint64_t sense_lat,
+				       uint64_t xfer_size)
+{
+	return sense_lat + DIV_ROUND_UP(xfer_size, UNIT_XFER_SIZE) * ch->perf_model->xfer_lat;
+}
+
+/*
+ * Under NAND_SCHED_GC_THROTTLE, GC programs/erases queued behind other work
+ * leave room in front of them for one flash page read of the slowest cell
+ * type, sized the same way read-first placement sizes the read.
+ */
+static inline uint64_t __ssd_throttle_gc(struct ssdparams *spp, struct ssd_channel *ch,
+					 struct nand_plane *pl, int type, uint64_t stime)
+{
+	uint64_t sense_lat = 0;
+	int i;
+
+	if (type != GC_IO || !(spp->sched_policy & NAND_SCHED_GC_THROTTLE) ||
+	    pl->next_pln_avail_time <= stime)
+		return pl->next_pln_avail_time;
+
+	for (i = 0; i < MAX_CELL_TYPES; i++)
+		sense_lat = max_t(uint64_t, sense_lat, spp->pg_rd_lat[i]);
+
+	return pl->next_pln_avail_time + __ssd_read_slot(ch, sense_lat, spp->flashpgsz);
+}
+
 uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd)
 {
 	int c = ncmd->cmd;
@@ -588,8 +907,13 @@ uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd)
 	uint64_t nand_stime, nand_etime;
 	uint64_t chnl_stime, chnl_etime;
 	uint64_t remaining, xfer_size, completed_time;
+	uint64_t susp_stime = 0, susp_extra = 0;
+	uint64_t sense_lat;
+	bool suspend = false, slotted = false;
 	struct ssdparams *spp;
 	struct nand_lun *lun;
+	struct nand_plane *pl;
+	struct nand_block *blk;
 	struct ssd_channel *ch;
 	struct ppa *ppa = ncmd->ppa;
 	uint32_t cell;
@@ -597,30 +921,67 @@ uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd)
 		"SSD: %p, Enter stime: %lld, ch %d lun %d blk %d page %d command %d ppa 0x%llx\n",
 		ssd, ncmd->stime, ppa->g.ch, ppa->g.lun, ppa->g.blk, ppa->g.pg, c, ppa->ppa);
 
-	if (ppa->ppa == UNMAPPED_PPA) {
+	if (ppa->ppa == UNMAPPED_PPA || ppa->ppa == UNCORRECTABLE_PPA) {
 		NVMEV_ERROR("Error ppa 0x%llx - %d\n", ppa->ppa, ncmd->cmd);
 		return cmd_stime;
 	}
 
 	spp = &ssd->sp;
 	lun = get_lun(ssd, ppa);
+	pl = get_pl(ssd, ppa);
+	blk = get_blk(ssd, ppa);
 	ch = get_ch(ssd, ppa);
 	cell = get_cell(ssd, ppa);
 	remaining = ncmd->xfer_size;
 
+	/*
+	 * Each plane keeps its own busy time so that operations on different
+	 * planes of a LUN (multi-plane read/program) overlap. The LUN busy time
+	 * is the latest of its planes. With a single plane both are identical.
+	 */
 	switch (c) {
 	case NAND_READ:
+		if (blk->slc) {
+			sense_lat = spp->slc_pg_rd_lat;
+		} else if (ncmd->xfer_size == 4096) {
+			sense_lat = spp->pg_4kb_rd_lat[cell];
+		} else {
+			sense_lat = spp->pg_rd_lat[cell];
+		}
+		/* a retry re-senses the whole page in the block's cell mode */
+		sense_lat += __ssd_read_retry_lat(
+			spp, blk, blk->slc ? spp->slc_pg_rd_lat : spp->pg_rd_lat[cell], cmd_stime);
+
 		/* read: perform NAND cmd first */
-		nand_stime = max(lun->next_lun_avail_time, cmd_stime);
+		if (spp->sched_policy & NAND_SCHED_READ_FIRST) {
+			nand_stime = __ssd_resv_find_gap(
+				pl, cmd_stime, __ssd_read_slot(ch, sense_lat, ncmd->xfer_size));
+			slotted = (nand_stime < pl->next_pln_avail_time);
+		}
 
-		if (ncmd->xfer_size == 4096) {
-			nand_etime = nand_stime + spp->pg_4kb_rd_lat[cell];
-		} else {
-			nand_etime = nand_stime + spp->pg_rd_lat[cell];
+		if (!slotted && __ssd_suspendable(spp, pl, cmd_stime)) {
+			if (cmd_stime < pl->susp_rd_etime) {
+				/* already suspended, queue behind the previous read */
+				susp_stime = pl->susp_rd_etime;
+				nand_stime = susp_stime;
+				suspend = true;
+			} else if (pl->nr_suspends < spp->max_suspends) {
+				susp_stime = cmd_stime;
+				susp_extra = spp->pg_res_lat;
+				nand_stime = susp_stime + spp->pg_sus_lat;
+				pl->nr_suspends++;
+				suspend = true;
+			}
 		}
 
-		/* read: then data transfer through channel */
+		if (!slotted && !suspend)
+			nand_stime = max(pl->next_pln_avail_time, cmd_stime);
+
+		nand_etime = nand_stime + sense_lat;
+
+		/* read: then data transfer through channel (none for on-die copyback) */
 		chnl_stime = nand_etime;
+		chnl_etime = completed_time = nand_etime;
 		// NVMEV_INFO("NAND Latency: %lld\n", nand_etime - nand_stime);
 
 		while (remaining) {
@@ -639,34 +1000,58 @@ uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd)
 
 		// NVMEV_INFO("Channel Latency: %lld\n", completed_time - nand_etime);
 
-		lun->next_lun_avail_time = chnl_etime;
+		if (slotted) {
+			/* read fits into an idle gap, unless the channel made it overrun */
+			__ssd_resv_shift(pl, nand_stime, chnl_etime);
+			__ssd_resv_add(spp, pl, nand_stime, chnl_etime);
+			pl->next_pln_avail_time = max(pl->next_pln_avail_time, chnl_etime);
+		} else if (suspend) {
+			/* resume: the program/erase is pushed out by the time it was held */
+			uint64_t etime = pl->susp_op_etime;
+
+			pl->susp_op_etime += chnl_etime - susp_stime + susp_extra;
+			pl->susp_rd_etime = chnl_etime;
+			pl->next_pln_avail_time = pl->susp_op_etime;
+			__ssd_resv_extend(pl, etime, pl->susp_op_etime);
+		} else {
+			__ssd_resv_add(spp, pl, nand_stime, chnl_etime);
+			pl->next_pln_avail_time = chnl_etime;
+		}
 		break;
 
 	case NAND_WRITE:
 		/* write: transfer data through channel first */
-		chnl_stime = max(lun->next_lun_avail_time, cmd_stime);
+		chnl_stime = max(__ssd_throttle_gc(spp, ch, pl, ncmd->type, cmd_stime), cmd_stime);
 
-		chnl_etime = chmodel_request(ch->perf_model, chnl_stime, ncmd->xfer_size);
+		if (ncmd->xfer_size)
+			chnl_etime = chmodel_request(ch->perf_model, chnl_stime, ncmd->xfer_size);
+		else
+			chnl_etime = chnl_stime;
 
 		/* write: then do NAND program */
 		nand_stime = chnl_etime;
-		nand_etime = nand_stime + spp->pg_wr_lat;
-		lun->next_lun_avail_time = nand_etime;
+		nand_etime = nand_stime + (blk->slc ? spp->slc_pg_wr_lat : spp->pg_wr_lat);
+		blk->prog_time = nand_etime;
+		pl->next_pln_avail_time = nand_etime;
+		__ssd_resv_add(spp, pl, chnl_stime, nand_etime);
+		__ssd_start_suspendable(pl, nand_stime, nand_etime);
 		completed_time = nand_etime;
 		break;
 
 	case NAND_ERASE:
 		/* erase: only need to advance NAND status */
-		nand_stime = max(lun->next_lun_avail_time, cmd_stime);
+		nand_stime = max(__ssd_throttle_gc(spp, ch, pl, ncmd->type, cmd_stime), cmd_stime);
 		nand_etime = nand_stime + spp->blk_er_lat;
-		lun->next_lun_avail_time = nand_etime;
+		pl->next_pln_avail_time = nand_etime;
+		__ssd_resv_add(spp, pl, nand_stime, nand_etime);
+		__ssd_start_suspendable(pl, nand_stime, nand_etime);
 		completed_time = nand_etime;
 		break;
 
 	case NAND_NOP:
-		/* no operation: just return last completed time of lun */
-		nand_stime = max(lun->next_lun_avail_time, cmd_stime);
-		lun->next_lun_avail_time = nand_stime;
+		/* no operation: just return last completed time of plane */
+		nand_stime = max(pl->next_pln_avail_time, cmd_stime);
+		pl->next_pln_avail_time = nand_stime;
 		completed_time = nand_stime;
 		break;
 
@@ -675,6 +1060,8 @@ uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd)
 		return 0;
 	}
 
+	lun->next_lun_avail_time = max(lun->next_lun_avail_time, pl->next_pln_avail_time);
+
 	return completed_time;
 }
 
@@ -26,9 +26,35 @@
 #define INVALID_PPA (~(0ULL))
 #define INVALID_LPN (~(0ULL))
 #define UNMAPPED_PPA (~(0ULL))
-#define GET_FTL_IDX(lpn) (lpn / (FLASH_PAGE_SIZE / LOGICAL_PAGE_SIZE) % SSD_PARTITIONS)
-#define LOCAL_LPN(lpn) ((lpn / ((FLASH_PAGE_SIZE / LOGICAL_PAGE_SIZE) * SSD_PARTITIONS))\
-		* (FLASH_PAGE_SIZE / LOGICAL_PAGE_SIZE) + (lpn % (FLASH_PAGE_SIZE / LOGICAL_PAGE_SIZE)))
+#define UNCORRECTABLE_PPA (~(1ULL)) /* lpn marked by Write Uncorrectable */
+
+/*
+ * Device profile. It starts from the ssd_config.h values of the build and
+ * can be changed with module parameters at load time.
+ */
+struct ssd_profile {
+	unsigned int nr_parts; /* FTL instances, each owning nchs / nr_parts channels */
+	unsigned int nchs;
+	unsigned int luns_per_ch;
+	unsigned int pgsz; /* mapping unit */
+	unsigned int flashpgsz;
+	unsigned int oneshotpgsz;
+	unsigned long wb_size; /* write buffer of all partitions */
+	unsigned int pg_rd_lat; /* 0 keeps the per-cell-type read latencies */
+	unsigned int pg_wr_lat;
+	unsigned int blk_er_lat;
+	unsigned int preage_pe; /* P/E cycles every block starts with */
+	unsigned int preage_days; /* age of the data at the time it is programmed */
+};
+
+extern struct ssd_profile ssd_profile;
+
+#define SSD_MAX_PARTITIONS (16)
+
+#define PGS_PER_FLASHPG (ssd_profile.flashpgsz / ssd_profile.pgsz)
+#define GET_FTL_IDX(lpn) (lpn / PGS_PER_FLASHPG % ssd_profile.nr_parts)
+#define LOCAL_LPN(lpn) ((lpn / (PGS_PER_FLASHPG * ssd_profile.nr_parts))\
+		* PGS_PER_FLASHPG + (lpn % PGS_PER_FLASHPG))
 
 enum {
 	NAND_READ = 0,
@@ -100,12 +126,32 @@ struct nand_block {
 	int vpc; /* valid page count */
 	int erase_cnt;
 	int wp; /* current write pointer */
+	uint64_t prog_time; /* last program, for retention */
+	bool slc; /* programmed in SLC mode */
+};
+
+#define NAND_RESV_SLOTS (8)
+
+struct nand_resv {
+	uint64_t stime;
+	uint64_t etime;
 };
 
 struct nand_plane {
 	struct nand_block *blk;
 	uint64_t next_pln_avail_time;
 	int nblks;
+
+	/* recent reservations sorted by stime, used to find idle gaps */
+	struct nand_resv resv[NAND_RESV_SLOTS];
+	int nr_resv;
+	uint64_t resv_floor; /* end of the reservations dropped from resv[] */
+
+	/* program/erase suspend state */
+	uint64_t susp_op_stime; /* NAND start of the last suspendable program/erase */
+	uint64_t susp_op_etime; /* completion of the last suspendable program/erase */
+	uint64_t susp_rd_etime; /* end of the reads serviced while suspended */
+	int nr_suspends;
 };
 
 struct nand_lun {
@@ -157,12 +203,14 @@ struct buffer {
 	size_t flush_threshold;
 	struct list_head free_ppgs;
 	struct list_head used_ppgs;
+	struct buffer_ppg *ppgs; /* ppg_per_buf entries */
+	struct buffer_page *pages; /* ppg_per_buf * pg_per_ppg entries */
 };
 
 /*
 lpn: logical page number
 valid: whether the block is valid. if false, the block is currently begin written to NAND
-sectors: represent the sectors of the page
+sectors: bitmap of the written sectors of the page (up to 64, a 32KB page of 512B sectors)
 list: list head for buffer
 */
 struct buffer_ppg {
@@ -176,7 +224,7 @@ struct buffer_ppg {
 struct buffer_page {
 	uint64_t lpn;
 	size_t free_secs;
-	bool *sectors;
+	uint64_t sectors;
 };
 
 /*
@@ -212,6 +260,25 @@ struct ssdparams {
 	int pg_rd_lat[MAX_CELL_TYPES]; /* NAND page read latency in nanoseconds. sensing time (tR) */
 	int pg_wr_lat; /* NAND page program latency in nanoseconds. pgm time (tPROG)*/
 	int blk_er_lat; /* NAND block erase latency in nanoseconds. erase time (tERASE) */
+	int slc_pg_rd_lat; /* page read latency of a block in SLC mode */
+	int slc_pg_wr_lat; /* page program latency of a block in SLC mode */
+	int slc_pgs_per_blk; /* # of pages of a block in SLC mode */
+	int pg_sus_lat; /* NAND program/erase suspend latency in nanoseconds (tSUS) */
+	int pg_res_lat; /* NAND program/erase resume latency in nanoseconds */
+	int max_suspends; /* # of suspends allowed per program/erase, 0 disables suspend */
+	int sched_policy; /* NAND_SCHED_* flags */
+
+	bool enable_reliability; /* read retry / soft decode model */
+	int endurance; /* P/E cycles */
+	uint64_t retention; /* data retention in nanoseconds */
+	int slc_endurance; /* P/E cycles of a block in SLC mode */
+	uint64_t slc_retention; /* data retention of a block in SLC mode */
+	int preage_pe; /* initial erase count of every block */
+	uint64_t preage_ret; /* added to the retention age of every read, in nanoseconds */
+	int rr_thres; /* permille of wear + retention before the first read retry */
+	int rr_step; /* permille per additional read retry */
+	int max_rr; /* # of read retries before soft decoding */
+	int soft_dec_lat; /* soft decode latency in nanoseconds */
 	int max_ch_xfer_size;
 
 	int fw_4kb_rd_lat; /* Firmware overhead of 4KB read of read in nanoseconds */
@@ -295,6 +362,7 @@ static inline uint32_t get_cell(struct ssd *ssd, struct ppa *ppa)
 	return (ppa->g.pg / spp->pgs_per_flashpg) % (spp->cell_mode);
 }
 
+int ssd_check_profile(void);
 void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts);
 void ssd_init(struct ssd *ssd, struct ssdparams *spp, uint32_t cpu_nr_dispatcher);
 void ssd_remove(struct ssd *ssd);
@@ -309,6 +377,7 @@ bool buffer_allocate(struct nvmev_ns *ns, uint64_t start_lpn, uint64_t end_lpn,
 bool buffer_release(struct buffer *buf, uint64_t complete_time);
 void buffer_refill(struct buffer *buf);
 struct buffer_page *buffer_search(struct buffer *buf, uint64_t lpn);
+void buffer_discard(struct buffer *buf, uint64_t start_lpn, uint64_t end_lpn);
 
 void adjust_ftl_latency(int target, int lat);
 #endif
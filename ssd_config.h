@@ -23,6 +23,11 @@
 #define CELL_MODE_TLC 3
 #define CELL_MODE_QLC 4
 
+/* NAND Scheduling Policy (flags) */
+#define NAND_SCHED_FCFS 0
+#define NAND_SCHED_READ_FIRST (1 << 0) /* slot reads into idle gaps of the timeline */
+#define NAND_SCHED_GC_THROTTLE (1 << 1) /* leave a read slot in front of queued GC ops */
+
 /* Must select one of INTEL_OPTANE, SAMSUNG_970PRO, or ZNS_PROTOTYPE
  * in Makefile */
 
@@ -36,9 +41,6 @@
 #define MDTS (5)
 #define CELL_MODE (CELL_MODE_UNKNOWN)
 
-#define LBA_BITS (9)
-#define LBA_SIZE (1 << LBA_BITS)
-
 #elif (BASE_SSD == KV_PROTOTYPE)
 #define NR_NAMESPACES 1
 
@@ -57,9 +59,6 @@ enum {
 #define KV_MAPPING_TABLE_SIZE GB(1)
 #define ALLOCATOR_TYPE ALLOCATOR_TYPE_APPEND_ONLY
 
-#define LBA_BITS (9)
-#define LBA_SIZE (1 << LBA_BITS)
-
 #elif (BASE_SSD == SAMSUNG_970PRO)
 #define NR_NAMESPACES 1
 
@@ -102,7 +101,11 @@ static_assert((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
 #define NAND_READ_LATENCY_MSB (36013 + 6000)
 #define NAND_READ_LATENCY_CSB (0) //not used
 #define NAND_PROG_LATENCY (185000)
-#define NAND_ERASE_LATENCY (0)
+#define NAND_ERASE_LATENCY (3000000)
+#define NAND_SUSPEND_LATENCY (20000) /* program/erase suspend (tSUS) */
+#define NAND_RESUME_LATENCY (5000)
+#define MAX_NAND_SUSPENDS (0) /* per program/erase, 0 disables suspend */
+#define NAND_SCHED_POLICY (NAND_SCHED_FCFS)
 
 #define FW_4KB_READ_LATENCY (21500)
 #define FW_READ_LATENCY (30490)
@@ -111,12 +114,22 @@ static_assert((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
 #define FW_CH_XFER_LATENCY (0)
 #define OP_AREA_PERCENT (0.07)
 
+#define SLC_CACHE_PERCENT (0) /* share of lines written in SLC mode, 0 disables */
+#define SLC_FOLD_IDLE (1000000) /* idle ns before SLC lines are folded */
+#define NAND_SLC_READ_LATENCY (20000)
+#define NAND_SLC_PROG_LATENCY (75000)
+
+#define READ_CACHE_FLASHPGS (0) /* per partition, 0 disables the read cache */
+#define READ_AHEAD_FLASHPGS (4) /* flash pages prefetched per partition */
+#define READ_AHEAD_TRIGGER (2) /* sequential commands before read-ahead starts */
+
+#define L2P_CACHE_SEGS (0) /* per partition, 0 keeps the whole map in device DRAM */
+#define HMB_READ_LATENCY (1000) /* PCIe round trip of a mapping fetch from the HMB */
+#define CMT_TPAGES (0) /* per partition, translation pages cached without an HMB */
+
 #define GLOBAL_WB_SIZE (NAND_CHANNELS * LUNS_PER_NAND_CH * ONESHOT_PAGE_SIZE * 2)
 #define WRITE_EARLY_COMPLETION 1
 
-#define LBA_BITS (9)
-#define LBA_SIZE (1 << LBA_BITS)
-
 #elif (BASE_SSD == ZNS_PROTOTYPE)
 #define NR_NAMESPACES 1
 
@@ -181,9 +194,6 @@ static_assert((ZONE_SIZE % DIES_PER_ZONE) == 0);
 #define ZRWA_SIZE (0)
 #define ZRWA_BUFFER_SIZE (0)
 
-#define LBA_BITS (9)
-#define LBA_SIZE (1 << LBA_BITS)
-
 #elif (BASE_SSD == WD_ZN540)
 #define NR_NAMESPACES 1
 
@@ -246,9 +256,106 @@ static_assert((ZONE_SIZE % DIES_PER_ZONE) == 0);
 #define ZRWA_SIZE (0)
 #define ZRWA_BUFFER_SIZE (0)
 
+#endif
+
+#ifndef LOGICAL_PAGE_SIZE
+#define LOGICAL_PAGE_SIZE KB(4)
+#endif
+
+#ifndef WRITE_EARLY_COMPLETION
+#define WRITE_EARLY_COMPLETION 0
+#endif
+
+#ifndef MAX_NAND_SUSPENDS
+#define NAND_SUSPEND_LATENCY (0)
+#define NAND_RESUME_LATENCY (0)
+#define MAX_NAND_SUSPENDS (0)
+#endif
+
+#ifndef NAND_SCHED_POLICY
+#define NAND_SCHED_POLICY (NAND_SCHED_FCFS)
+#endif
+
+/* the slot GC_THROTTLE leaves is only ever filled by read-first placement */
+#if (NAND_SCHED_POLICY & NAND_SCHED_GC_THROTTLE) && !(NAND_SCHED_POLICY & NAND_SCHED_READ_FIRST)
+#error "NAND_SCHED_GC_THROTTLE requires NAND_SCHED_READ_FIRST"
+#endif
+
+/*
+ * NAND reliability model: wear (erase count) and retention (time since
+ * program) raise the bit error rate, which costs read retries and finally a
+ * soft decode. Set NAND_RELIABILITY to 1 to enable it.
+ */
+#ifndef NAND_RELIABILITY
+#define NAND_RELIABILITY (0)
+#endif
+
+/* rating of blocks run in SLC mode, also of an SLC device */
+#define NAND_SLC_ENDURANCE (100000) /* P/E cycles */
+#define NAND_SLC_RETENTION_SECS (10 * 365 * 86400ULL)
+
+#if (CELL_MODE == CELL_MODE_SLC)
+#define NAND_ENDURANCE NAND_SLC_ENDURANCE
+#define NAND_RETENTION_SECS NAND_SLC_RETENTION_SECS
+#elif (CELL_MODE == CELL_MODE_MLC)
+#define NAND_ENDURANCE (6000)
+#define NAND_RETENTION_SECS (365 * 86400ULL)
+#elif (CELL_MODE == CELL_MODE_TLC)
+#define NAND_ENDURANCE (3000)
+#define NAND_RETENTION_SECS (365 * 86400ULL)
+#else
+#define NAND_ENDURANCE (1000)
+#define NAND_RETENTION_SECS (180 * 86400ULL)
+#endif
+
+/*
+ * Pre-aging: every block starts with NAND_PREAGE_PE_CYCLES erases and its
+ * data is NAND_PREAGE_DAYS older than the time it was programmed at, so that
+ * a worn device can be modelled without writing it out first.
+ */
+#ifndef NAND_PREAGE_PE_CYCLES
+#define NAND_PREAGE_PE_CYCLES (0)
+#endif
+#ifndef NAND_PREAGE_DAYS
+#define NAND_PREAGE_DAYS (0)
+#endif
+
+/*
+ * LBA format: 9 for 512B sectors, 12 for 4KiB native sectors (lbaf 3).
+ * Override with -DLBA_BITS=12.
+ */
+#ifndef LBA_BITS
 #define LBA_BITS (9)
+#endif
 #define LBA_SIZE (1 << LBA_BITS)
+static_assert(LBA_BITS == 9 || LBA_BITS == 12);
+
+#ifndef SLC_CACHE_PERCENT
+#define SLC_CACHE_PERCENT (0)
+#define SLC_FOLD_IDLE (0)
+#define NAND_SLC_READ_LATENCY (0)
+#define NAND_SLC_PROG_LATENCY (0)
 #endif
+
+/*
+ * DRAM-less controller: only L2P_CACHE_SEGS mapping segments are cached on
+ * the device, the rest of the map lives in the host memory buffer. Without
+ * an HMB, CMT_TPAGES translation pages are cached and the rest is read from
+ * and written to NAND (DFTL).
+ */
+#ifndef L2P_CACHE_SEGS
+#define L2P_CACHE_SEGS (0)
+#define HMB_READ_LATENCY (0)
+#endif
+
+#ifndef CMT_TPAGES
+#define CMT_TPAGES (0)
+#endif
+
+#define NAND_RR_THRES (500) /* permille of endurance + retention before the first retry */
+#define NAND_RR_STEP (250) /* permille per additional retry */
+#define NAND_MAX_READ_RETRY (8) /* soft decode after this */
+#define NAND_SOFT_DECODE_LATENCY (40000) //ns
 ///////////////////////////////////////////////////////////////////////////
 
 static const uint32_t ns_ssd_type[] = { NS_SSD_TYPE_0, NS_SSD_TYPE_1 };
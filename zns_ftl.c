@@ -120,6 +120,12 @@ static void zns_init_ftl(struct zns_ftl *zns_ftl, struct znsparams *zpp, struct
 	__init_resource(zns_ftl);
 }
 
+/* zones cannot straddle the end of the namespace */
+uint64_t zns_fit_namespace_size(uint64_t size)
+{
+	return rounddown(size, (uint64_t)ZONE_SIZE);
+}
+
 void zns_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
 			uint32_t cpu_nr_dispatcher)
 {
@@ -173,7 +179,7 @@ static void zns_flush(struct nvmev_ns *ns, struct nvmev_request *req, struct nvm
 	uint32_t i;
 	struct zns_ftl *zns_ftl = (struct zns_ftl *)ns->ftls;
 
-	start = local_clock();
+	start = req->nsecs_start;
 	latest = start;
 	for (i = 0; i < ns->nr_parts; i++) {
 		latest = max(latest, ssd_next_idle_time(zns_ftl[i].ssd));
@@ -196,6 +202,7 @@ bool zns_proc_nvme_io_cmd(struct nvmev_ns *ns, struct nvmev_request *req, struct
 	switch (cmd->common.opcode) {
 	case nvme_cmd_write:
 	case nvme_cmd_zone_append:
+	case nvme_cmd_write_zeroes:
 		if (!zns_write(ns, req, ret))
 			return false;
 		break;
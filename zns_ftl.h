@@ -132,6 +132,7 @@ static inline uint64_t lba_to_lpn(struct zns_ftl *zns_ftl, uint64_t lba)
 }
 
 /* zns external interface */
+uint64_t zns_fit_namespace_size(uint64_t size);
 void zns_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
 			uint32_t cpu_nr_dispatcher);
 void zns_remove_namespace(struct nvmev_ns *ns);
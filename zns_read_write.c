@@ -171,7 +171,10 @@ static bool __zns_write(struct zns_ftl *zns_ftl, struct nvmev_request *req,
 
 	// get delay from nand model
 	nsecs_latest = nsecs_start;
-	nsecs_latest = ssd_advance_write_buffer(zns_ftl->ssd, nsecs_latest, LBA_TO_BYTE(nr_lba));
+	/* Write zeroes still advances the zone, but no data comes from the host */
+	if (cmd->opcode != nvme_cmd_write_zeroes)
+		nsecs_latest = ssd_advance_write_buffer(zns_ftl->ssd, nsecs_latest,
+							LBA_TO_BYTE(nr_lba));
 	nsecs_xfer_completed = nsecs_latest;
 
 	for (lpn = slpn; lpn <= elpn; lpn += pgs) {
@@ -214,7 +217,8 @@ static bool __zns_write(struct zns_ftl *zns_ftl, struct nvmev_request *req,
 out:
 	ret->status = status;
 	if ((cmd->control & NVME_RW_FUA) ||
-	    (spp->write_early_completion == 0)) /*Wait all flash operations*/
+	    (spp->write_early_completion == 0) ||
+	    !nvmev_vdev->vwc_enabled) /*Wait all flash operations*/
 		ret->nsecs_target = nsecs_latest;
 	else /*Early completion*/
 		ret->nsecs_target = nsecs_xfer_completed;
@@ -371,7 +375,8 @@ out:
 	ret->status = status;
 
 	if ((cmd->control & NVME_RW_FUA) ||
-	    (spp->write_early_completion == 0)) /*Wait all flash operations*/
+	    (spp->write_early_completion == 0) ||
+	    !nvmev_vdev->vwc_enabled) /*Wait all flash operations*/
 		ret->nsecs_target = nsecs_latest;
 	else /*Early completion*/
 		ret->nsecs_target = nsecs_xfer_completed;